@@ -0,0 +1,742 @@
+/*
+ * buddy.c - binary buddy allocator behind the default heap calls of mm.h
+ * (mm_init, mm_malloc, mm_free, mm_realloc and friends), an alternative
+ * engine to mm.c that the trace driver runs as mdriver-buddy. it serves
+ * workloads of power of two buffers, which it fits without any waste.
+ *
+ * the heap is grown with mem_sbrk and seen as the lower part of one block
+ * of order top, the largest power of two the region holds: a block of
+ * order o is 2^o bytes at an offset from base that is a multiple of 2^o,
+ * and its buddy is the block at the offset with bit o flipped. an alloc
+ * takes the first free block of its order or above from the per-order
+ * free lists and splits it in halves down to its order, pushing the upper
+ * halves back. a free merges the block with its buddy for as long as the
+ * buddy is free, one order up at a time. both are O(orders).
+ *
+ * blocks have no header, so a block's payload is the whole block. the
+ * buddy state lives in two bitmaps per order, mapped apart from the heap:
+ * free_map has the bit of each block on the free list of its order, and
+ * alloc_map the bit of each alloc'd block, from which mm_free finds the
+ * order of a block. a free block links to the next and previous block of
+ * its list through its first two words, so the smallest block is 16 bytes.
+ *
+ * the heap grows by the block an alloc needs, of GROW_ORDER at least:
+ * blocks are sbrk'd at offsets aligned to their size, so the gap up to
+ * that offset is sbrk'd first as free blocks of lower orders. mm_realloc
+ * resizes in place when the block shrinks, or when the upper buddies of
+ * each order it grows through are free or past the end of heap.
+ *
+ * every call holds one mutex. there are no independent heaps (mm_heap_*),
+ * no mmapped blocks and no thread caches; mm_set_mmap_threshold does
+ * nothing and mm_mmapped is 0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+//CONSTANTS
+#define MIN_ORDER		4	//log2 of the smallest block, two free list links
+#ifndef MAX_ORDER
+#if __SIZEOF_POINTER__ == 4
+#define MAX_ORDER		30	//log2 of the largest block
+#else
+#define MAX_ORDER		40
+#endif
+#endif
+#define ORDERS			( MAX_ORDER - MIN_ORDER + 1 )
+#ifndef GROW_ORDER
+#define GROW_ORDER		12	//least order the heap grows by
+#endif
+#define ALIGNMENT		( 1 << MIN_ORDER )
+
+//STATISTICS
+#ifndef MM_STATS
+#define MM_STATS		1	//0 compiles the counters of mm_stats out
+#endif
+
+#if ORDERS > MM_STATS_CLASSES || ORDERS > 64
+#error "MAX_ORDER leaves more orders than MM_STATS_CLASSES or the avail word hold"
+#endif
+#if GROW_ORDER < MIN_ORDER
+#error "GROW_ORDER must be at least MIN_ORDER"
+#endif
+
+//MACROS
+#define MAX( x, y ) 		( ( x ) > ( y ) ? ( x ) : ( y ) )
+#define MIN( x, y ) 		( ( x ) < ( y ) ? ( x ) : ( y ) )
+#define BLOCK_SIZE(o)		( (size_t)1 << ( o ) )
+#define BLOCK(off)		( (struct buddy_block*)( heap.base + ( off ) ) )
+#define OFFSET(p)		( (size_t)( (char*)( p ) - heap.base ) )
+#define ORDER_BIT(o)		( 1ULL << ( ( o ) - MIN_ORDER ) )
+#define WORD_BITS		( 8 * sizeof( unsigned long ) )
+#define BIT_GET(map, off, o)	( ( map )[( ( off ) >> ( o ) ) / WORD_BITS] >> ( ( ( off ) >> ( o ) ) % WORD_BITS ) & 1 )
+#define BIT_SET(map, off, o)	( ( map )[( ( off ) >> ( o ) ) / WORD_BITS] |= 1UL << ( ( ( off ) >> ( o ) ) % WORD_BITS ) )
+#define BIT_CLEAR(map, off, o)	( ( map )[( ( off ) >> ( o ) ) / WORD_BITS] &= ~( 1UL << ( ( ( off ) >> ( o ) ) % WORD_BITS ) ) )
+#define IS_FREE(off, o)		BIT_GET( heap.free_map[( o ) - MIN_ORDER], off, o )
+#define IS_ALLOC(off, o)	BIT_GET( heap.alloc_map[( o ) - MIN_ORDER], off, o )
+
+#if MM_STATS
+#define STAT(field, n)		( heap.stats.field += ( n ) )
+#define STAT_LIVE(n)		( heap.stats.live_bytes += ( n ), \
+				  heap.stats.peak_bytes = MAX( heap.stats.peak_bytes, heap.stats.live_bytes ) )
+#else
+#define STAT(field, n)		( (void)0 )
+#define STAT_LIVE(n)		( (void)0 )
+#endif
+
+//TYPES
+/*
+ * buddy_block - links of a free block on the list of its order.
+ */
+struct buddy_block {
+  struct buddy_block *next;
+  struct buddy_block *prev;
+};
+
+/*
+ * buddy_heap - state of the heap over memlib's default region.
+ */
+struct buddy_heap {
+  pthread_mutex_t lock;		//held by every public call
+  char *base;			//first byte of heap, block offsets are from here
+  size_t size;			//bytes sbrk'd from base on
+  int top;			//order of the largest block the region holds
+  struct buddy_block *lists[ORDERS];	//free blocks per order
+  unsigned long long avail;	//ORDER_BIT(o) set when the list of order o is non empty
+  unsigned long *free_map[ORDERS];	//bit per block of each order, set if on its free list
+  unsigned long *alloc_map[ORDERS];	//bit per block of each order, set if alloc'd
+  void *maps;			//mapping of the bitmaps
+  size_t maps_len;		//its length
+  void *last;			//block alloc'd or resized by the last call, see mm_check_last
+  void *last_freed;		//free block the last call made
+#if MM_STATS
+  struct mm_stats stats;	//counters, see mm_stats
+#endif
+};
+
+//GLOBAL SCALARS
+static struct buddy_heap heap = {
+  .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+//METHOD DEFINITIONS
+static void *buddy_malloc(size_t size);
+static void buddy_free(void *p);
+static int get_order(size_t size);
+static int block_order(size_t off);
+static int grow_heap(int order);
+static size_t release(size_t off, int order);
+static void list_push(size_t off, int order);
+static void list_remove(size_t off, int order);
+static int check_free(size_t off, int order);
+static int check_fail(const char *msg, void *p);
+
+
+/*
+ * mm_init - initialize the malloc package over memlib's default region
+ * from its current brk on, which is aligned to ALIGNMENT first. the
+ * bitmaps are mapped anew for the largest block the rest of the region
+ * holds.
+ *
+ * returns: 0 if successful, -1 on failure
+ */
+int mm_init( void )
+{
+  char *brk = (char*)mem_heap_hi() + 1;
+  size_t pad, room, bits = 0;
+  int o;
+
+  pad = -(unsigned long)brk % ALIGNMENT;
+  if( pad != 0 && mem_sbrk( pad ) == (void*)-1 )
+    return -1;
+  room = mem_maxheap() - mem_heapsize();
+  if( room < BLOCK_SIZE( MIN_ORDER ) )
+    return -1;
+
+  if( heap.maps != NULL )
+    munmap( heap.maps, heap.maps_len );
+  memset( heap.lists, 0, sizeof( heap.lists ) );
+  heap.base = brk + pad;
+  heap.size = 0;
+  heap.top = MIN( MAX_ORDER, (int)( sizeof( long ) * 8 - 1 ) - __builtin_clzl( room ) );
+  heap.avail = 0;
+  heap.last = NULL;
+  heap.last_freed = NULL;
+#if MM_STATS
+  memset( &heap.stats, 0, sizeof( heap.stats ) );
+#endif
+  STAT( sbrk_calls, pad != 0 );
+  STAT( sbrk_bytes, pad );
+
+  for( o = MIN_ORDER; o <= heap.top; o++ )
+    bits += ( ( BLOCK_SIZE( heap.top - o ) + WORD_BITS - 1 ) / WORD_BITS ) * WORD_BITS;
+  heap.maps_len = 2 * bits / 8;
+  heap.maps = mmap( NULL, heap.maps_len, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+  if( heap.maps == MAP_FAILED ){
+    heap.maps = NULL;
+    return -1;
+  }
+
+  unsigned long *map = heap.maps;
+  for( o = MIN_ORDER; o <= heap.top; o++ ){
+    size_t words = ( BLOCK_SIZE( heap.top - o ) + WORD_BITS - 1 ) / WORD_BITS;
+
+    heap.free_map[o - MIN_ORDER] = map;
+    heap.alloc_map[o - MIN_ORDER] = map + words;
+    map += 2 * words;
+  }
+  return 0;
+}
+
+/*
+ * mm_malloc - allocate a block of the order of size, see buddy_malloc.
+ *
+ * size_t size: size of alloc request
+ *
+ * returns: NULL if failure occurs, otherwise ptr to the block
+ */
+void *mm_malloc( size_t size )
+{
+  void *p;
+
+  pthread_mutex_lock( &heap.lock );
+  p = buddy_malloc( size );
+  pthread_mutex_unlock( &heap.lock );
+  return p;
+}
+
+/*
+ * mm_free - free block p, merging it with its free buddies. see
+ * buddy_free.
+ *
+ * void* p: ptr to the block, or NULL
+ */
+void mm_free( void *p )
+{
+  if( p == NULL )
+    return;
+  pthread_mutex_lock( &heap.lock );
+  buddy_free( p );
+  pthread_mutex_unlock( &heap.lock );
+}
+
+/*
+ * mm_realloc - resize block p to size. a block of the order of size
+ * stays as it is; a larger block gives its upper halves back down to the
+ * order of size; a smaller block takes in its upper buddies up to that
+ * order when each is free or past the end of heap, which is extended for
+ * them. otherwise a new block is alloc'd, the payload copied and p freed.
+ *
+ * void* p: ptr to the block, or NULL to alloc
+ * size_t size: new size, or 0 to free
+ *
+ * returns: NULL if failure occurs (p is left alone), otherwise ptr to the block
+ */
+void *mm_realloc( void *p, size_t size )
+{
+  if( p == NULL )
+    return mm_malloc( size );
+  if( size == 0 ){
+    mm_free( p );
+    return NULL;
+  }
+
+  pthread_mutex_lock( &heap.lock );
+
+  size_t off = OFFSET( p );
+  int o = block_order( off ), n = get_order( size ), k;
+  void *q = NULL;
+
+  if( o < 0 || n > heap.top )
+    goto out;
+  STAT( reallocs, 1 );
+
+  if( n <= o ){
+    STAT( realloc_paths[n == o ? MM_REALLOC_FITS : MM_REALLOC_SHRINK], 1 );
+    if( n < o ){
+      STAT_LIVE( BLOCK_SIZE( n ) - BLOCK_SIZE( o ) );
+      BIT_CLEAR( heap.alloc_map[o - MIN_ORDER], off, o );
+      for( k = o - 1; k >= n; k-- ){
+        release( off + BLOCK_SIZE( k ), k );
+        STAT( splits, 1 );
+      }
+      BIT_SET( heap.alloc_map[n - MIN_ORDER], off, n );
+      heap.last_freed = BLOCK( off + BLOCK_SIZE( n ) );
+    }
+    heap.last = p;
+    q = p;
+    goto out;
+  }
+
+  for( k = o; k < n; k++ ){
+    size_t u = off + BLOCK_SIZE( k );
+
+    if( off & BLOCK_SIZE( k ) || ( u < heap.size && !IS_FREE( u, k ) ) )
+      break;
+  }
+  if( k == n && off + BLOCK_SIZE( n ) <= BLOCK_SIZE( heap.top ) ){
+    size_t end = off + BLOCK_SIZE( n );
+
+    if( end > heap.size ){
+      if( mem_sbrk( end - heap.size ) == (void*)-1 )
+        goto move;
+      STAT( sbrk_calls, 1 );
+      STAT( sbrk_bytes, end - heap.size );
+    }
+    for( k = o; k < n; k++ )
+      if( off + BLOCK_SIZE( k ) < heap.size )
+        list_remove( off + BLOCK_SIZE( k ), k );
+    STAT( realloc_paths[end > heap.size ? MM_REALLOC_EXTEND : MM_REALLOC_ABSORB], 1 );
+    heap.size = MAX( heap.size, end );
+    BIT_CLEAR( heap.alloc_map[o - MIN_ORDER], off, o );
+    BIT_SET( heap.alloc_map[n - MIN_ORDER], off, n );
+    STAT_LIVE( BLOCK_SIZE( n ) - BLOCK_SIZE( o ) );
+    heap.last = p;
+    heap.last_freed = NULL;
+    q = p;
+    goto out;
+  }
+
+move:
+  if( ( q = buddy_malloc( size ) ) != NULL ){
+    memcpy( q, p, BLOCK_SIZE( o ) );
+    buddy_free( p );
+    STAT( realloc_paths[MM_REALLOC_MOVE], 1 );
+    heap.last = q;
+  }
+out:
+  pthread_mutex_unlock( &heap.lock );
+  return q;
+}
+
+/*
+ * mm_usable_size - bytes of the block of ptr that the caller may use, the
+ * whole block of its order.
+ *
+ * void* ptr: ptr to the block, or null
+ *
+ * returns: size_t usable bytes, 0 for a null ptr
+ */
+size_t mm_usable_size( void *ptr )
+{
+  int o;
+
+  if( ptr == NULL )
+    return 0;
+  pthread_mutex_lock( &heap.lock );
+  o = block_order( OFFSET( ptr ) );
+  pthread_mutex_unlock( &heap.lock );
+  return o < 0 ? 0 : BLOCK_SIZE( o );
+}
+
+/*
+ * mm_trim - give the free blocks at the end of heap back with
+ * mem_shrink_brk, as long as the heap stays at least pad bytes. stops
+ * at the first block memlib refuses, which stays on its free list.
+ *
+ * returns: 1 if memory was released, 0 otherwise
+ */
+int mm_trim( size_t pad )
+{
+  int o, ret = 0;
+
+  pthread_mutex_lock( &heap.lock );
+  for( ;; ){
+    size_t off = heap.size;
+
+    for( o = MIN_ORDER; o <= heap.top && heap.size % BLOCK_SIZE( o ) == 0 && heap.size >= BLOCK_SIZE( o ); o++ )
+      if( IS_FREE( heap.size - BLOCK_SIZE( o ), o ) ){
+        off = heap.size - BLOCK_SIZE( o );
+        break;
+      }
+    if( off == heap.size || off < pad )
+      break;
+    list_remove( off, o );
+    if( mem_shrink_brk( BLOCK_SIZE( o ) ) == (void*)-1 ){
+      list_push( off, o );
+      break;
+    }
+    heap.size = off;
+    STAT( trims, 1 );
+    STAT( trim_bytes, BLOCK_SIZE( o ) );
+    ret = 1;
+  }
+  pthread_mutex_unlock( &heap.lock );
+  return ret;
+}
+
+/*
+ * mm_set_mmap_threshold - nothing, every block is in the heap.
+ */
+void mm_set_mmap_threshold( size_t threshold )
+{
+  (void)threshold;
+}
+
+/*
+ * mm_mmapped - 0, no block is mmapped.
+ */
+size_t mm_mmapped( void )
+{
+  return 0;
+}
+
+/*
+ * mm_stats - statistics of the heap, with the orders as classes. see
+ * struct mm_stats.
+ */
+void mm_stats( struct mm_stats *s )
+{
+  struct buddy_block *b;
+  int o;
+
+  pthread_mutex_lock( &heap.lock );
+#if MM_STATS
+  *s = heap.stats;
+  s->counted = 1;
+#else
+  memset( s, 0, sizeof( *s ) );
+#endif
+  s->heap_bytes = heap.size;
+  s->classes = heap.top - MIN_ORDER + 1;
+  for( o = MIN_ORDER; o <= heap.top; o++ ){
+    s->class_min[o - MIN_ORDER] = BLOCK_SIZE( o );
+    for( b = heap.lists[o - MIN_ORDER]; b != NULL; b = b->next ){
+      s->free_blocks[o - MIN_ORDER]++;
+      s->free_bytes[o - MIN_ORDER] += BLOCK_SIZE( o );
+    }
+  }
+  pthread_mutex_unlock( &heap.lock );
+}
+
+/*
+ * mm_check - check the heap: walking it from base, every block has
+ * exactly one free or alloc bit at its offset, ends inside the heap and,
+ * if free, has no free buddy. the free lists hold exactly the free
+ * blocks, each on the list of its order, and avail marks the non empty
+ * lists.
+ *
+ * returns: 0 if the heap is consistent, -1 otherwise
+ */
+int mm_check( void )
+{
+  struct buddy_block *b, *prev;
+  size_t off, free_count = 0, listed = 0;
+  int o, ret = -1;
+
+  pthread_mutex_lock( &heap.lock );
+  for( off = 0; off < heap.size; off += BLOCK_SIZE( o ) ){
+    int k, states = 0;
+
+    o = -1;
+    for( k = MIN_ORDER; k <= heap.top && off % BLOCK_SIZE( k ) == 0; k++ )
+      if( IS_FREE( off, k ) + IS_ALLOC( off, k ) ){
+        states += IS_FREE( off, k ) + IS_ALLOC( off, k );
+        o = k;
+      }
+    if( states != 1 ){
+      check_fail( states ? "block with several states" : "offset in no block", BLOCK( off ) );
+      goto out;
+    }
+    if( off + BLOCK_SIZE( o ) > heap.size ){
+      check_fail( "block runs past end of heap", BLOCK( off ) );
+      goto out;
+    }
+    if( IS_FREE( off, o ) ){
+      free_count++;
+      if( o < heap.top && IS_FREE( off ^ BLOCK_SIZE( o ), o ) ){
+        check_fail( "free buddies not merged", BLOCK( off ) );
+        goto out;
+      }
+    }
+  }
+
+  for( o = MIN_ORDER; o <= heap.top; o++ ){
+    if( !( heap.avail & ORDER_BIT( o ) ) != ( heap.lists[o - MIN_ORDER] == NULL ) ){
+      check_fail( "avail disagrees with free lists", heap.lists[o - MIN_ORDER] );
+      goto out;
+    }
+    for( prev = NULL, b = heap.lists[o - MIN_ORDER]; b != NULL; prev = b, b = b->next ){
+      off = OFFSET( b );
+      if( (char*)b < heap.base || off >= heap.size ){
+        check_fail( "free list link outside heap", b );
+        goto out;
+      }
+      if( off % BLOCK_SIZE( o ) || !IS_FREE( off, o ) ){
+        check_fail( "free list holds a block not free at its order", b );
+        goto out;
+      }
+      if( b->prev != prev ){
+        check_fail( "free list prev link does not match next link", b );
+        goto out;
+      }
+      if( ++listed > free_count ){
+        check_fail( "free lists hold a block twice", b );
+        goto out;
+      }
+    }
+  }
+  if( listed != free_count ){
+    check_fail( "free block missing from free lists", NULL );
+    goto out;
+  }
+  ret = 0;
+out:
+  pthread_mutex_unlock( &heap.lock );
+  return ret;
+}
+
+/*
+ * mm_check_last - check only what the last call changed: the block it
+ * returned is alloc'd, and the free block it made (if not trimmed since)
+ * is on the list of its order and has no free buddy.
+ *
+ * returns: 0 if the blocks are consistent, -1 otherwise
+ */
+int mm_check_last( void )
+{
+  int o, ret = 0;
+
+  pthread_mutex_lock( &heap.lock );
+  if( heap.last != NULL && block_order( OFFSET( heap.last ) ) < 0 )
+    ret = check_fail( "returned block is not alloc'd", heap.last );
+  else if( heap.last_freed != NULL && OFFSET( heap.last_freed ) < heap.size ){
+    size_t off = OFFSET( heap.last_freed );
+
+    for( o = MIN_ORDER; o <= heap.top && off % BLOCK_SIZE( o ) == 0; o++ )
+      if( IS_FREE( off, o ) )
+        break;
+    if( o > heap.top || off % BLOCK_SIZE( o ) )
+      ret = check_fail( "freed block is not free", heap.last_freed );
+    else
+      ret = check_free( off, o );
+  }
+  pthread_mutex_unlock( &heap.lock );
+  return ret;
+}
+
+/*
+ * buddy_malloc - allocate a block of the order of size: the first free
+ * block of that order or above is taken off its list and split down to
+ * the order, the upper halves going back on the lists below. the heap
+ * is grown when no list holds one. heap lock held.
+ *
+ * size_t size: size of alloc request
+ *
+ * returns: NULL if failure occurs, otherwise ptr to the block
+ */
+static void *buddy_malloc( size_t size )
+{
+  unsigned long long fit;
+  size_t off;
+  int o, j;
+
+  if( size == 0 || ( o = get_order( size ) ) > heap.top )
+    return NULL;
+
+  STAT( fit_searches, 1 );
+  STAT( fit_probes, 1 );
+  if( ( fit = heap.avail & -ORDER_BIT( o ) ) == 0 ){
+    if( grow_heap( o ) < 0 )
+      return NULL;
+    fit = heap.avail & -ORDER_BIT( o );
+  }
+  j = MIN_ORDER + __builtin_ctzll( fit );
+  off = OFFSET( heap.lists[j - MIN_ORDER] );
+  list_remove( off, j );
+  while( j > o ){
+    j--;
+    list_push( off + BLOCK_SIZE( j ), j );
+    STAT( splits, 1 );
+  }
+  BIT_SET( heap.alloc_map[o - MIN_ORDER], off, o );
+
+  STAT( mallocs, 1 );
+  STAT_LIVE( BLOCK_SIZE( o ) );
+  heap.last = BLOCK( off );
+  heap.last_freed = NULL;
+  return heap.last;
+}
+
+/*
+ * buddy_free - free block p and merge it with its free buddies, see
+ * release. a ptr that is not an alloc'd block is ignored. heap lock held.
+ *
+ * void* p: ptr to the block
+ */
+static void buddy_free( void *p )
+{
+  size_t off = OFFSET( p );
+  int o = block_order( off );
+
+  if( o < 0 )
+    return;
+  BIT_CLEAR( heap.alloc_map[o - MIN_ORDER], off, o );
+  STAT( frees, 1 );
+  STAT_LIVE( -BLOCK_SIZE( o ) );
+  heap.last = NULL;
+  heap.last_freed = BLOCK( release( off, o ) );
+}
+
+/*
+ * get_order - order of the block that fits size bytes, at least MIN_ORDER.
+ *
+ * returns: int order
+ */
+static int get_order( size_t size )
+{
+  if( size <= BLOCK_SIZE( MIN_ORDER ) )
+    return MIN_ORDER;
+  if( size > BLOCK_SIZE( MAX_ORDER ) )
+    return MAX_ORDER + 1;
+  return (int)( sizeof( long ) * 8 ) - __builtin_clzl( size - 1 );
+}
+
+/*
+ * block_order - order of the alloc'd block at off, from the alloc bits of
+ * the orders off is aligned to.
+ *
+ * returns: int order, -1 if no block is alloc'd at off
+ */
+static int block_order( size_t off )
+{
+  int o;
+
+  if( off >= heap.size )
+    return -1;
+  for( o = MIN_ORDER; o <= heap.top && off % BLOCK_SIZE( o ) == 0; o++ )
+    if( IS_ALLOC( off, o ) )
+      return o;
+  return -1;
+}
+
+/*
+ * grow_heap - extend the heap with a free block of the given order, or of
+ * GROW_ORDER if larger. the block must start at a multiple of its size, so
+ * the bytes up to there are first sbrk'd and released as the largest
+ * blocks the end of heap is aligned to. released blocks merge with the
+ * free blocks at the end of heap.
+ *
+ * int order: order the caller needs a free block of
+ *
+ * returns: 0 if successful, -1 if the region is full
+ */
+static int grow_heap( int order )
+{
+  int o = MIN( MAX( order, GROW_ORDER ), heap.top );
+  size_t end = ( ( heap.size + BLOCK_SIZE( o ) - 1 ) & ~( BLOCK_SIZE( o ) - 1 ) ) + BLOCK_SIZE( o );
+
+  if( end > BLOCK_SIZE( heap.top ) || end - heap.size > mem_maxheap() - mem_heapsize() )
+    return -1;
+  if( mem_sbrk( end - heap.size ) == (void*)-1 )
+    return -1;
+  STAT( sbrk_calls, 1 );
+  STAT( sbrk_bytes, end - heap.size );
+
+  while( heap.size < end ){
+    int k = heap.size == 0 ? o : MIN( __builtin_ctzl( heap.size ), o );
+    size_t off = heap.size;
+
+    heap.size += BLOCK_SIZE( k );
+    release( off, k );
+  }
+  return 0;
+}
+
+/*
+ * release - put the free block of the given order at off on its list,
+ * first merging it with its buddy for as long as the buddy is free. a
+ * buddy past the end of heap has no free bit, so the heap is never left.
+ *
+ * returns: size_t offset of the merged block
+ */
+static size_t release( size_t off, int order )
+{
+  while( order < heap.top ){
+    size_t buddy = off ^ BLOCK_SIZE( order );
+
+    if( !IS_FREE( buddy, order ) )
+      break;
+    list_remove( buddy, order );
+    if( buddy < off )
+      STAT( coalesce_prev, 1 );
+    else
+      STAT( coalesce_next, 1 );
+    off &= ~BLOCK_SIZE( order );
+    order++;
+  }
+  list_push( off, order );
+  return off;
+}
+
+/*
+ * list_push - push the free block at off on the list of its order and
+ * mark it free.
+ */
+static void list_push( size_t off, int order )
+{
+  struct buddy_block *b = BLOCK( off ), **head = &heap.lists[order - MIN_ORDER];
+
+  b->next = *head;
+  b->prev = NULL;
+  if( *head != NULL )
+    ( *head )->prev = b;
+  *head = b;
+  heap.avail |= ORDER_BIT( order );
+  BIT_SET( heap.free_map[order - MIN_ORDER], off, order );
+}
+
+/*
+ * list_remove - unlink the free block at off from the list of its order
+ * and clear its free bit.
+ */
+static void list_remove( size_t off, int order )
+{
+  struct buddy_block *b = BLOCK( off ), **head = &heap.lists[order - MIN_ORDER];
+
+  if( b->prev != NULL )
+    b->prev->next = b->next;
+  else
+    *head = b->next;
+  if( b->next != NULL )
+    b->next->prev = b->prev;
+  if( *head == NULL )
+    heap.avail &= ~ORDER_BIT( order );
+  BIT_CLEAR( heap.free_map[order - MIN_ORDER], off, order );
+}
+
+/*
+ * check_free - check that the free block at off is on the list of its
+ * order and that its buddy is not free.
+ *
+ * returns: 0 if the block is consistent, -1 otherwise
+ */
+static int check_free( size_t off, int order )
+{
+  struct buddy_block *b;
+
+  if( order < heap.top && IS_FREE( off ^ BLOCK_SIZE( order ), order ) )
+    return check_fail( "free buddies not merged", BLOCK( off ) );
+  for( b = heap.lists[order - MIN_ORDER]; b != NULL; b = b->next )
+    if( b == BLOCK( off ) )
+      return 0;
+  return check_fail( "free block missing from its free list", BLOCK( off ) );
+}
+
+/*
+ * check_fail - report a failed heap check of block p.
+ *
+ * returns: -1
+ */
+static int check_fail( const char *msg, void *p )
+{
+  fprintf( stderr, "mm_check: %s at %p\n", msg, p );
+  return -1;
+}
@@ -0,0 +1,54 @@
+#ifndef __CONFIG_H_
+#define __CONFIG_H_
+
+/*
+ * config.h - malloc lab configuration file
+ *
+ * Settings of the mdriver benchmark. memlib.c also includes this file,
+ * so MAX_HEAP may be defined here to override its default.
+ */
+
+/*
+ * This is the default path where the driver will look for the
+ * default tracefiles. You can override it at runtime with the -t flag.
+ */
+#define TRACEDIR "./traces/"
+
+/*
+ * This is the list of default tracefiles in TRACEDIR that the driver
+ * will use for testing. Modify this if you want to add or delete
+ * traces from the driver's test suite. The gen-* traces are written
+ * by gentrace, see the traces target of the Makefile.
+ */
+#define DEFAULT_TRACEFILES \
+  "short1.rep",	\
+  "short2.rep",	\
+  "short3.rep",	\
+  "gen-zipf.rep",	\
+  "gen-bimodal.rep",	\
+  "gen-lognormal.rep",	\
+  "gen-stack.rep",	\
+  "gen-realloc.rep",	\
+  "gen-phased.rep"
+
+/*
+ * This constant gives the estimated performance of the libc malloc
+ * package on the reference machine, in ops/sec. The driver scores
+ * throughput relative to it unless -l measures libc on this machine.
+ */
+#define AVG_LIBC_THRUPUT	20E6
+
+/*
+ * This constant determines the contributions of space utilization
+ * (UTIL_WEIGHT) and throughput (1 - UTIL_WEIGHT) to the performance
+ * index.
+ */
+#define UTIL_WEIGHT		.60
+
+/*
+ * Each speed measurement replays its trace until at least this many
+ * seconds have passed, and reports the average time of one replay.
+ */
+#define MIN_SPEED_SECS		0.05
+
+#endif /* __CONFIG_H_ */
@@ -0,0 +1,663 @@
+/*
+ * gentrace.c - synthetic allocation trace generator
+ *
+ * Writes a trace in the format read by mdriver from parameterized
+ * distributions, so that workloads can be shared and reproduced without
+ * shipping real traces. The output only depends on the options and the
+ * seed: the generator has its own random number generator.
+ *
+ * A trace is one or more phases run back to back. Each phase has its own
+ * op count, size distribution, lifetime distribution and realloc rate,
+ * and blocks alloc'd in one phase may be freed in a later one. Whatever
+ * is still alloc'd at the end of the last phase is freed, so every trace
+ * is balanced.
+ *
+ * Size distributions (-d):
+ *   zipf:<n>:<s>          sizes 8, 16, .. 8n, size 8k with weight 1/k^s
+ *   bimodal:<a>:<b>:<p>   sizes near a with probability p, else near b
+ *   lognormal:<mu>:<sig>  sizes exp(N(mu, sig))
+ *   fixed:<s1>,<s2>,..    sizes picked uniformly from a set
+ *   uniform:<lo>:<hi>     sizes picked uniformly from lo..hi
+ *
+ * Lifetime distributions (-l), in ops:
+ *   exp:<mean>            exponential lifetimes
+ *   stack                 blocks are freed in LIFO order
+ *   long:<frac>:<mean>    frac of the blocks live until the end of the
+ *                         trace, the others have exponential lifetimes
+ *
+ * Realloc chains (-r <pct>:<factor>): pct percent of the ops realloc a
+ * live block to factor times its size. a chain keeps growing the same
+ * block most of the time, the way a buffer grows while it is filled.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <errno.h>
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define MAXLINE       1024  /* max string size */
+#define MAXPHASES       16  /* max number of -p phases */
+#define MAXFIXED        64  /* max sizes in a fixed set */
+#define CHAIN_STAY    0.80  /* probability a realloc continues its chain */
+#define NEVER   ((unsigned long)-1)  /* death time of blocks not on the heap */
+
+/******************************
+ * The key compound data types
+ *****************************/
+
+/* A size distribution */
+typedef struct {
+    enum {ZIPF, BIMODAL, LOGNORMAL, FIXED, UNIFORM} type;
+    int n;                /* zipf ranks, or fixed set size */
+    double a, b, p;       /* distribution parameters */
+    double *cdf;          /* zipf cumulative weights */
+    size_t set[MAXFIXED]; /* fixed set */
+} sizedist_t;
+
+/* A lifetime distribution */
+typedef struct {
+    enum {EXP, STACK, LONG} type;
+    double mean;          /* mean lifetime of exponential lifetimes */
+    double frac;          /* fraction of long-lived blocks */
+} lifedist_t;
+
+/* One phase of the trace */
+typedef struct {
+    long ops;             /* ops in the phase */
+    sizedist_t size;
+    lifedist_t life;
+    double realloc_pct;   /* percent of ops that are reallocs */
+    double realloc_factor;/* growth factor of a realloc */
+} phase_t;
+
+/* One op of the trace as written out */
+typedef struct {
+    char type;            /* 'a', 'r' or 'f' */
+    int id;
+    size_t size;
+} op_t;
+
+/* A live block */
+typedef struct {
+    size_t size;
+    unsigned long death;  /* op count at which it is freed, or NEVER */
+    int heap_pos;         /* position on the death heap, or -1 */
+    int stack_pos;        /* position on the LIFO stack, or -1 */
+    int live_pos;         /* position in the live array */
+} block_t;
+
+/********************
+ * Global variables
+ *******************/
+
+static unsigned long long rng_state;   /* state of the generator */
+
+static size_t max_size = 1 << 20;      /* sizes are clamped to 1..max_size */
+static int max_live = 4096;            /* most blocks live at once */
+
+static block_t *blocks;                /* blocks by id */
+static int *free_ids, num_free_ids;    /* ids not in use */
+static int num_ids;                    /* ids handed out so far */
+static int *live, num_live;            /* ids of live blocks */
+static int *heap, heap_len;            /* min-heap of ids by death time */
+static int *stack, stack_len;          /* ids of blocks freed LIFO */
+
+static op_t *ops;                      /* ops written so far */
+static long num_ops, max_ops;
+static size_t live_bytes, peak_bytes;  /* live payload and its peak */
+
+/*********************
+ * Function prototypes
+ *********************/
+
+static double rng_uniform(void);
+static double rng_normal(void);
+static double rng_exp(double mean);
+
+static void parse_size(char *spec, sizedist_t *d);
+static void parse_life(char *spec, lifedist_t *d);
+static void parse_realloc(char *spec, phase_t *phase);
+static void parse_phase(char *spec, phase_t *phase);
+static size_t draw_size(sizedist_t *d);
+
+static void run_phase(phase_t *phase, unsigned long *t);
+static int alloc_block(size_t size, unsigned long death);
+static void free_block(int id);
+static void realloc_block(int id, size_t size);
+static void emit(char type, int id, size_t size);
+
+static void heap_push(int id);
+static void heap_remove(int id);
+static void heap_swap(int i, int j);
+
+static void usage(void);
+static void app_error(char *msg);
+static void unix_error(char *msg);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int c, i;
+    phase_t phases[MAXPHASES];
+    int num_phases = 0;
+    phase_t base;
+    char *outfile = NULL;
+    FILE *out;
+    unsigned long t = 0;
+    unsigned long long seed = 1;
+
+    memset(&base, 0, sizeof(base));
+    base.ops = 10000;
+    parse_size("uniform:1:512", &base.size);
+    parse_life("exp:100", &base.life);
+    base.realloc_factor = 1.5;
+
+    while ((c = getopt(argc, argv, "s:n:d:l:r:p:m:i:o:h")) != EOF) {
+	switch (c) {
+	case 's': /* Seed */
+	    seed = strtoull(optarg, NULL, 0);
+	    break;
+	case 'n': /* Ops of the single phase */
+	    base.ops = atol(optarg);
+	    break;
+	case 'd': /* Size distribution */
+	    parse_size(optarg, &base.size);
+	    break;
+	case 'l': /* Lifetime distribution */
+	    parse_life(optarg, &base.life);
+	    break;
+	case 'r': /* Realloc chains */
+	    parse_realloc(optarg, &base);
+	    break;
+	case 'p': /* One more phase */
+	    if (num_phases == MAXPHASES)
+		app_error("Too many phases");
+	    phases[num_phases] = base;
+	    parse_phase(optarg, &phases[num_phases++]);
+	    break;
+	case 'm': /* Largest request size */
+	    max_size = strtoul(optarg, NULL, 0);
+	    break;
+	case 'i': /* Most live blocks */
+	    max_live = atoi(optarg);
+	    break;
+	case 'o': /* Output file */
+	    outfile = optarg;
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+
+    if (num_phases == 0)
+	phases[num_phases++] = base;
+    if (max_live < 1 || max_size < 1)
+	app_error("-i and -m must be positive");
+
+    /* splitmix64 never gets stuck, whatever the seed */
+    rng_state = seed;
+
+    /* Size the tables: each op adds at most one op and one id */
+    for (i = 0; i < num_phases; i++)
+	max_ops += phases[i].ops;
+    max_ops += max_live;
+    if ((ops = malloc(max_ops * sizeof(op_t))) == NULL ||
+	(blocks = calloc(max_live, sizeof(block_t))) == NULL ||
+	(free_ids = malloc(max_live * sizeof(int))) == NULL ||
+	(live = malloc(max_live * sizeof(int))) == NULL ||
+	(heap = malloc(max_live * sizeof(int))) == NULL ||
+	(stack = malloc(max_live * sizeof(int))) == NULL)
+	unix_error("malloc failed in main");
+
+    for (i = 0; i < num_phases; i++)
+	run_phase(&phases[i], &t);
+
+    /* Free whatever is left, youngest first */
+    while (num_live > 0)
+	free_block(live[num_live - 1]);
+
+    /* Write the trace */
+    if (outfile == NULL)
+	out = stdout;
+    else if ((out = fopen(outfile, "w")) == NULL)
+	unix_error("Could not open output file");
+
+    fprintf(out, "%zu\n%d\n%ld\n%d\n", peak_bytes, num_ids, num_ops, 1);
+    for (i = 0; i < num_ops; i++) {
+	if (ops[i].type == 'f')
+	    fprintf(out, "f %d\n", ops[i].id);
+	else
+	    fprintf(out, "%c %d %zu\n", ops[i].type, ops[i].id, ops[i].size);
+    }
+
+    if (out != stdout && fclose(out) != 0)
+	unix_error("Could not write output file");
+    exit(0);
+}
+
+/*****************************************************************
+ * Workload simulation
+ *****************************************************************/
+
+/*
+ * run_phase - generate the ops of one phase. t counts the ops of the
+ *     whole trace and is the clock that lifetimes are measured in. blocks
+ *     whose time has come are freed first; otherwise the op is a free
+ *     (stack lifetimes, half the time), a realloc or an alloc.
+ */
+static void run_phase(phase_t *phase, unsigned long *t)
+{
+    long n;
+    int chain = -1;
+
+    for (n = 0; n < phase->ops; n++, (*t)++) {
+
+	/* Blocks due to be freed */
+	if (heap_len > 0 && blocks[heap[0]].death <= *t) {
+	    free_block(heap[0]);
+	    continue;
+	}
+
+	/* LIFO frees */
+	if (phase->life.type == STACK && stack_len > 0 && rng_uniform() < 0.5) {
+	    free_block(stack[stack_len - 1]);
+	    continue;
+	}
+
+	/* Realloc chains */
+	if (num_live > 0 && rng_uniform() * 100 < phase->realloc_pct) {
+	    if (chain < 0 || blocks[chain].live_pos < 0 ||
+		rng_uniform() >= CHAIN_STAY)
+		chain = live[(int)(rng_uniform() * num_live)];
+	    realloc_block(chain, blocks[chain].size * phase->realloc_factor + 1);
+	    continue;
+	}
+
+	/* Allocs, making room if too many blocks are live */
+	if (num_live == max_live)
+	    free_block(heap_len > 0 ? heap[0] :
+		       stack_len > 0 ? stack[stack_len - 1] :
+		       live[(int)(rng_uniform() * num_live)]);
+
+	unsigned long death;
+	switch (phase->life.type) {
+	case STACK:
+	    death = NEVER;
+	    break;
+	case LONG:
+	    if (rng_uniform() < phase->life.frac) {
+		death = NEVER;
+		break;
+	    }
+	    /* fall through */
+	default:
+	    death = *t + 1 + (unsigned long)rng_exp(phase->life.mean);
+	}
+
+	int id = alloc_block(draw_size(&phase->size), death);
+	if (phase->life.type == STACK) {
+	    blocks[id].stack_pos = stack_len;
+	    stack[stack_len++] = id;
+	}
+    }
+}
+
+/*
+ * alloc_block - emit an alloc of size under a free id, which dies at
+ *     op count death
+ */
+static int alloc_block(size_t size, unsigned long death)
+{
+    int id = num_free_ids > 0 ? free_ids[--num_free_ids] : num_ids++;
+    block_t *b = &blocks[id];
+
+    b->size = size;
+    b->death = death;
+    b->heap_pos = -1;
+    b->stack_pos = -1;
+    b->live_pos = num_live;
+    live[num_live++] = id;
+    if (death != NEVER)
+	heap_push(id);
+
+    emit('a', id, size);
+    live_bytes += size;
+    if (live_bytes > peak_bytes)
+	peak_bytes = live_bytes;
+    return id;
+}
+
+/*
+ * free_block - emit a free of block id and take it off every list
+ */
+static void free_block(int id)
+{
+    block_t *b = &blocks[id];
+
+    if (b->heap_pos >= 0)
+	heap_remove(id);
+    if (b->stack_pos >= 0) {
+	/* only the top is ever freed LIFO, but the cap can free any */
+	int top = stack[--stack_len];
+	stack[b->stack_pos] = top;
+	blocks[top].stack_pos = b->stack_pos;
+	b->stack_pos = -1;
+    }
+
+    int last = live[--num_live];
+    live[b->live_pos] = last;
+    blocks[last].live_pos = b->live_pos;
+    b->live_pos = -1;
+
+    free_ids[num_free_ids++] = id;
+    live_bytes -= b->size;
+    emit('f', id, 0);
+}
+
+/*
+ * realloc_block - emit a realloc of block id to size, clamped to max_size
+ */
+static void realloc_block(int id, size_t size)
+{
+    if (size > max_size)
+	size = max_size;
+
+    live_bytes += size - blocks[id].size;
+    if (live_bytes > peak_bytes)
+	peak_bytes = live_bytes;
+    blocks[id].size = size;
+    emit('r', id, size);
+}
+
+/*
+ * emit - append an op to the trace
+ */
+static void emit(char type, int id, size_t size)
+{
+    if (num_ops == max_ops)
+	app_error("Op table overflow in emit");
+    ops[num_ops].type = type;
+    ops[num_ops].id = id;
+    ops[num_ops].size = size;
+    num_ops++;
+}
+
+/*
+ * heap_push - add block id to the min-heap of death times
+ */
+static void heap_push(int id)
+{
+    int i = heap_len++;
+
+    heap[i] = id;
+    blocks[id].heap_pos = i;
+    while (i > 0 && blocks[heap[(i - 1) / 2]].death > blocks[heap[i]].death) {
+	heap_swap(i, (i - 1) / 2);
+	i = (i - 1) / 2;
+    }
+}
+
+/*
+ * heap_remove - remove block id from the min-heap of death times
+ */
+static void heap_remove(int id)
+{
+    int i = blocks[id].heap_pos;
+
+    heap_swap(i, --heap_len);
+    blocks[id].heap_pos = -1;
+    if (i == heap_len)
+	return;
+
+    /* the moved block may need to go either way */
+    while (i > 0 && blocks[heap[(i - 1) / 2]].death > blocks[heap[i]].death) {
+	heap_swap(i, (i - 1) / 2);
+	i = (i - 1) / 2;
+    }
+    for (;;) {
+	int l = 2 * i + 1, r = l + 1, m = i;
+	if (l < heap_len && blocks[heap[l]].death < blocks[heap[m]].death)
+	    m = l;
+	if (r < heap_len && blocks[heap[r]].death < blocks[heap[m]].death)
+	    m = r;
+	if (m == i)
+	    break;
+	heap_swap(i, m);
+	i = m;
+    }
+}
+
+/*
+ * heap_swap - swap two entries of the min-heap
+ */
+static void heap_swap(int i, int j)
+{
+    int t = heap[i];
+
+    heap[i] = heap[j];
+    heap[j] = t;
+    blocks[heap[i]].heap_pos = i;
+    blocks[heap[j]].heap_pos = j;
+}
+
+/*****************************************************************
+ * Distributions
+ *****************************************************************/
+
+/*
+ * draw_size - draw a request size from distribution d
+ */
+static size_t draw_size(sizedist_t *d)
+{
+    double s;
+    int lo, hi;
+
+    switch (d->type) {
+    case ZIPF: /* binary search of the cumulative weights */
+	s = rng_uniform() * d->cdf[d->n - 1];
+	lo = 0;
+	hi = d->n - 1;
+	while (lo < hi) {
+	    int mid = (lo + hi) / 2;
+	    if (d->cdf[mid] < s)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	s = 8.0 * (lo + 1);
+	break;
+    case BIMODAL: /* +-25% around either mode */
+	s = rng_uniform() < d->p ? d->a : d->b;
+	s *= 0.75 + 0.5 * rng_uniform();
+	break;
+    case LOGNORMAL:
+	s = exp(d->a + d->b * rng_normal());
+	break;
+    case FIXED:
+	s = d->set[(int)(rng_uniform() * d->n)];
+	break;
+    default: /* UNIFORM */
+	s = d->a + rng_uniform() * (d->b - d->a + 1);
+    }
+
+    if (s < 1)
+	return 1;
+    if (s > max_size)
+	return max_size;
+    return (size_t)s;
+}
+
+/*
+ * parse_size - parse a size distribution spec, see the top of this file
+ */
+static void parse_size(char *spec, sizedist_t *d)
+{
+    int i;
+    char *p;
+
+    memset(d, 0, sizeof(*d));
+    if (sscanf(spec, "zipf:%d:%lf", &d->n, &d->a) == 2 && d->n > 0) {
+	d->type = ZIPF;
+	if ((d->cdf = malloc(d->n * sizeof(double))) == NULL)
+	    unix_error("malloc failed in parse_size");
+	for (i = 0; i < d->n; i++)
+	    d->cdf[i] = (i ? d->cdf[i - 1] : 0) + 1 / pow(i + 1, d->a);
+    }
+    else if (sscanf(spec, "bimodal:%lf:%lf:%lf", &d->a, &d->b, &d->p) == 3)
+	d->type = BIMODAL;
+    else if (sscanf(spec, "lognormal:%lf:%lf", &d->a, &d->b) == 2)
+	d->type = LOGNORMAL;
+    else if (sscanf(spec, "uniform:%lf:%lf", &d->a, &d->b) == 2 && d->a <= d->b)
+	d->type = UNIFORM;
+    else if (strncmp(spec, "fixed:", 6) == 0) {
+	d->type = FIXED;
+	for (p = spec + 6; *p && d->n < MAXFIXED; p += strcspn(p, ","), p += *p == ',')
+	    if ((d->set[d->n++] = strtoul(p, NULL, 0)) == 0)
+		app_error("Bogus fixed size set");
+	if (d->n == 0)
+	    app_error("Empty fixed size set");
+    }
+    else {
+	fprintf(stderr, "Bogus size distribution: %s\n", spec);
+	exit(1);
+    }
+}
+
+/*
+ * parse_life - parse a lifetime distribution spec, see the top of this file
+ */
+static void parse_life(char *spec, lifedist_t *d)
+{
+    memset(d, 0, sizeof(*d));
+    if (sscanf(spec, "exp:%lf", &d->mean) == 1)
+	d->type = EXP;
+    else if (strcmp(spec, "stack") == 0)
+	d->type = STACK;
+    else if (sscanf(spec, "long:%lf:%lf", &d->frac, &d->mean) == 2)
+	d->type = LONG;
+    else {
+	fprintf(stderr, "Bogus lifetime distribution: %s\n", spec);
+	exit(1);
+    }
+}
+
+/*
+ * parse_realloc - parse a realloc chain spec <pct>:<factor>
+ */
+static void parse_realloc(char *spec, phase_t *phase)
+{
+    if (sscanf(spec, "%lf:%lf", &phase->realloc_pct, &phase->realloc_factor) != 2)
+	app_error("Bogus realloc spec");
+}
+
+/*
+ * parse_phase - parse a phase spec <ops>/<size dist>/<lifetime dist>
+ *     [/<realloc spec>]. parts not given are taken from -d, -l and -r.
+ */
+static void parse_phase(char *spec, phase_t *phase)
+{
+    char buf[MAXLINE];
+    char *part;
+
+    strncpy(buf, spec, MAXLINE - 1);
+    buf[MAXLINE - 1] = '\0';
+
+    if ((part = strtok(buf, "/")) == NULL || (phase->ops = atol(part)) <= 0)
+	app_error("Bogus phase op count");
+    if ((part = strtok(NULL, "/")) != NULL)
+	parse_size(part, &phase->size);
+    if ((part = strtok(NULL, "/")) != NULL)
+	parse_life(part, &phase->life);
+    if ((part = strtok(NULL, "/")) != NULL)
+	parse_realloc(part, phase);
+}
+
+/*
+ * rng_uniform - uniform double in [0, 1) from a splitmix64 generator,
+ *     so that traces are the same on every platform for a given seed
+ */
+static double rng_uniform(void)
+{
+    unsigned long long z = (rng_state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z = z ^ (z >> 31);
+    return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * rng_normal - standard normal variate (Box-Muller)
+ */
+static double rng_normal(void)
+{
+    double u = 1.0 - rng_uniform(); /* (0, 1] */
+
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * rng_uniform());
+}
+
+/*
+ * rng_exp - exponential variate of the given mean
+ */
+static double rng_exp(double mean)
+{
+    return -mean * log(1.0 - rng_uniform());
+}
+
+/*************************************
+ * Some miscellaneous helper routines
+ ************************************/
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+/*
+ * unix_error - Report a Unix-style error
+ */
+static void unix_error(char *msg)
+{
+    fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: gentrace [-h] [-s <seed>] [-n <ops>] [-d <sizes>] [-l <lifetimes>]\n");
+    fprintf(stderr, "                [-r <pct>:<factor>] [-p <phase>].. [-m <max size>]\n");
+    fprintf(stderr, "                [-i <max live>] [-o <file>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-s <seed>      Seed of the random number generator (default 1).\n");
+    fprintf(stderr, "\t-n <ops>       Ops of the trace when no -p is given (default 10000).\n");
+    fprintf(stderr, "\t-d <sizes>     Size distribution (default uniform:1:512).\n");
+    fprintf(stderr, "\t-l <lifetimes> Lifetime distribution (default exp:100).\n");
+    fprintf(stderr, "\t-r <pct>:<f>   Realloc pct%% of ops, growing blocks by f (default 0:1.5).\n");
+    fprintf(stderr, "\t-p <phase>     Add a phase <ops>[/<sizes>[/<lifetimes>[/<pct>:<f>]]];\n");
+    fprintf(stderr, "\t               omitted parts come from the -d, -l, -r given before it.\n");
+    fprintf(stderr, "\t-m <max size>  Largest request size (default 1048576).\n");
+    fprintf(stderr, "\t-i <max live>  Most blocks live at once (default 4096).\n");
+    fprintf(stderr, "\t-o <file>      Write the trace to <file> rather than stdout.\n");
+    fprintf(stderr, "\t-h             Print this message.\n");
+    fprintf(stderr, "Sizes: zipf:<n>:<s> bimodal:<a>:<b>:<p> lognormal:<mu>:<sigma>\n");
+    fprintf(stderr, "       fixed:<s1>,<s2>,.. uniform:<lo>:<hi>\n");
+    fprintf(stderr, "Lifetimes: exp:<mean> stack long:<frac>:<mean>\n");
+}
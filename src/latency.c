@@ -0,0 +1,121 @@
+/*
+ * latency.c - log-bucketed latency histograms, see latency.h
+ *
+ * Values are recorded in timer ticks and only converted to ns when a
+ * histogram is read, with the tick rate and the cost of reading the timer
+ * measured once by lat_init.
+ */
+#include <stdio.h>
+#include <time.h>
+
+#include "latency.h"
+
+#define LAT_SUBS     (1 << LAT_SUB_BITS)
+#define CALIB_NS     20000000ULL  /* ns spent measuring the tick rate */
+#define CALIB_READS  1000         /* timer reads to find its own cost */
+
+static double ns_per_tick = 1.0;           /* tick rate of lat_now */
+static unsigned long long timer_ticks = 0; /* cost of a lat_now pair */
+
+static unsigned long long clock_ns(void);
+
+/*
+ * lat_init - measure the tick rate of lat_now against the monotonic
+ *     clock, and the cost of two back to back lat_now calls, which
+ *     lat_record takes off every value
+ */
+void lat_init(void)
+{
+    unsigned long long t0, c0, t1, c1, min = ~0ULL;
+    int i;
+
+    t0 = clock_ns();
+    c0 = lat_now();
+    do {
+	t1 = clock_ns();
+    } while (t1 - t0 < CALIB_NS);
+    c1 = lat_now();
+    ns_per_tick = (double)(t1 - t0) / (c1 - c0);
+
+    for (i = 0; i < CALIB_READS; i++) {
+	unsigned long long a = lat_now();
+	unsigned long long b = lat_now();
+	if (b - a < min)
+	    min = b - a;
+    }
+    timer_ticks = min;
+}
+
+/*
+ * lat_record - record a latency of ticks timer ticks, less the cost of
+ *     reading the timer
+ */
+void lat_record(lat_hist_t *h, unsigned long long ticks)
+{
+    int idx;
+
+    ticks = ticks > timer_ticks ? ticks - timer_ticks : 0;
+    if (ticks < LAT_SUBS)
+	idx = ticks;
+    else {
+	int shift = (63 - __builtin_clzll(ticks)) - LAT_SUB_BITS;
+	idx = ((shift + 1) << LAT_SUB_BITS) + ((ticks >> shift) & (LAT_SUBS - 1));
+    }
+
+    h->buckets[idx]++;
+    h->count++;
+    if (ticks > h->max)
+	h->max = ticks;
+}
+
+/*
+ * lat_percentile_ns - the latency in ns that pct percent of the values
+ *     recorded in h do not exceed, rounded up to the top of its bucket
+ *     but never above the largest value recorded
+ */
+double lat_percentile_ns(lat_hist_t *h, double pct)
+{
+    unsigned long long rank, seen = 0, top;
+    int idx;
+
+    if (h->count == 0)
+	return 0;
+
+    rank = (unsigned long long)(h->count * pct / 100.0);
+    if (rank >= h->count)
+	rank = h->count - 1;
+
+    for (idx = 0; idx < LAT_BUCKETS; idx++) {
+	seen += h->buckets[idx];
+	if (seen > rank)
+	    break;
+    }
+
+    if (idx < LAT_SUBS)
+	top = idx;
+    else {
+	int shift = (idx >> LAT_SUB_BITS) - 1;
+	top = ((unsigned long long)(LAT_SUBS + (idx & (LAT_SUBS - 1))) << shift)
+	    + (1ULL << shift) - 1;
+    }
+    return lat_ns(top < h->max ? top : h->max);
+}
+
+/*
+ * lat_ns - convert timer ticks to ns
+ */
+double lat_ns(unsigned long long ticks)
+{
+    return ticks * ns_per_tick;
+}
+
+/*
+ * clock_ns - monotonic clock in ns
+ */
+static unsigned long long clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
@@ -0,0 +1,46 @@
+/*
+ * latency.h - log-bucketed latency histograms
+ *
+ * A histogram keeps 2^LAT_SUB_BITS buckets per power of two, so every
+ * recorded value is known to within 1/2^LAT_SUB_BITS of itself, like an
+ * HDR histogram, in a fixed array that needs no allocation.
+ */
+#ifndef __LATENCY_H_
+#define __LATENCY_H_
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+#define LAT_SUB_BITS 4
+#define LAT_BUCKETS  ((64 - LAT_SUB_BITS + 1) << LAT_SUB_BITS)
+
+typedef struct {
+    unsigned long long count;               /* values recorded */
+    unsigned long long max;                 /* largest value recorded */
+    unsigned long long buckets[LAT_BUCKETS];
+} lat_hist_t;
+
+void lat_init(void);
+void lat_record(lat_hist_t *h, unsigned long long ticks);
+double lat_percentile_ns(lat_hist_t *h, double pct);
+double lat_ns(unsigned long long ticks);
+
+/*
+ * lat_now - read the timer in ticks: the TSC where there is one, else
+ *     the monotonic clock in ns
+ */
+static inline unsigned long long lat_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+#endif /* __LATENCY_H_ */
@@ -0,0 +1,1133 @@
+/*
+ * mdriver.c - malloc lab driver
+ *
+ * Replays allocation traces against mm.c and reports, per trace, whether
+ * the allocator served it correctly, its peak space utilization, its
+ * throughput and how its heap grew, then combines utilization and
+ * throughput into a performance index. With -l the same traces are also
+ * timed against the libc malloc package as a baseline.
+ *
+ * A trace file starts with four header lines followed by one op per line:
+ *
+ *   <suggested heap size>   (ignored)
+ *   <number of block ids>
+ *   <number of ops>
+ *   <weight>                (ignored)
+ *   a <id> <size>           alloc size bytes as block id
+ *   r <id> <size>           realloc block id to size bytes
+ *   f <id>                  free block id
+ *
+ * Each trace is replayed three times: once with every check on (see
+ * eval_mm_valid), once to measure utilization (eval_mm_util) and
+ * repeatedly to measure speed (eval_mm_speed), the last with no checks
+ * in the timed loop. With -L each trace is replayed once more with
+ * every call timed (eval_latency), to report latency percentiles per
+ * operation and request size; the speed replays never read the timer.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+#include "latency.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+/* Misc */
+#define MAXLINE     1024 /* max string size */
+#define HDRLINES       4 /* number of header lines in a trace file */
+#define LINENUM(i) (i+HDRLINES+1) /* cnvt trace request nums to linenums (origin 1) */
+
+/* Payloads returned by mm_malloc and mm_realloc must be aligned to this */
+#define ALIGNMENT 8
+
+/* Returns true if p is ALIGNMENT-byte aligned */
+#define IS_ALIGNED(p)  ((((uintptr_t)(p)) % ALIGNMENT) == 0)
+
+/* Latency histograms: one per op type and request size class, plus one
+ * per op type over all sizes at index LAT_CLASSES */
+#define LAT_OPS      3
+#define LAT_CLASSES  8
+
+/******************************
+ * The key compound data types
+ *****************************/
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    int index;                        /* index for free() to use later */
+    size_t size;                      /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* Holds the information for one trace file */
+typedef struct {
+    int num_ids;          /* number of alloc/realloc ids */
+    int num_ops;          /* number of distinct requests */
+    traceop_t *ops;       /* array of requests */
+    char **blocks;        /* array of ptrs returned by malloc/realloc... */
+    size_t *block_sizes;  /* ... and a corresponding array of payload sizes */
+    unsigned char *fills; /* ... and the byte each payload is filled with */
+} trace_t;
+
+/*
+ * Holds the results of replaying one trace: its validity, peak
+ * utilization, speed and heap growth under mm.c
+ */
+typedef struct {
+    double ops;      /* number of ops (malloc/free/realloc) in the trace */
+    int valid;       /* was the trace processed correctly by the allocator? */
+    double util;     /* peak live payload / peak footprint */
+    double secs;     /* number of secs needed to run the trace once */
+    size_t heap;     /* peak footprint: heap size plus mmapped bytes */
+    size_t sbrks;    /* mem_sbrk calls made while replaying the trace */
+} stats_t;
+
+/********************
+ * Global variables
+ *******************/
+int verbose = 0;        /* global flag for verbose output */
+static int errors = 0;  /* number of errs found when running student malloc */
+static int check_heap = 0; /* 1: mm_check_last after every call, 2: mm_check */
+
+/* Latency histograms of mm and libc malloc, filled in by eval_latency */
+static lat_hist_t mm_lat[LAT_OPS][LAT_CLASSES + 1];
+static lat_hist_t libc_lat[LAT_OPS][LAT_CLASSES + 1];
+
+/* Upper bounds of the request size classes of the latency histograms */
+static size_t lat_class_max[LAT_CLASSES] = {
+    16, 64, 256, 1024, 4096, 16384, 131072, (size_t)-1
+};
+
+/* Default tracefiles in TRACEDIR */
+static char *default_tracefiles[] = {
+    DEFAULT_TRACEFILES, NULL
+};
+
+/*********************
+ * Function prototypes
+ *********************/
+
+static trace_t *read_trace(char *tracedir, char *filename);
+static void free_trace(trace_t *trace);
+
+static int eval_mm_valid(trace_t *trace, int tracenum);
+static double eval_mm_util(trace_t *trace, size_t *heap, size_t *sbrks);
+static double eval_mm_speed(trace_t *trace);
+static double eval_libc_speed(trace_t *trace);
+
+static void replay_mm(trace_t *trace);
+static void replay_libc(trace_t *trace);
+static double time_replay(void (*replay)(trace_t *), trace_t *trace);
+static void eval_latency(trace_t *trace, lat_hist_t lat[][LAT_CLASSES + 1],
+			 int libc);
+static int lat_class(size_t size);
+static double now_secs(void);
+
+static void printresults(char *title, int n, stats_t *stats, int with_mm);
+static void printlatency(char *title, lat_hist_t lat[][LAT_CLASSES + 1]);
+
+static void usage(void);
+static void unix_error(char *msg);
+static void malloc_error(int tracenum, int opnum, char *msg);
+static void app_error(char *msg);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int i;
+    int c;
+    char **tracefiles = NULL;  /* null-terminated array of trace file names */
+    int num_tracefiles = 0;    /* the number of traces in that array */
+    trace_t *trace = NULL;     /* stores a single trace file in memory */
+    stats_t *libc_results = NULL; /* libc stats for each trace */
+    stats_t *mm_results = NULL;   /* mm (i.e. student) stats for each trace */
+
+    int run_libc = 0;    /* If set, run libc malloc (set by -l) */
+    int run_latency = 0; /* If set, time every call (set by -L) */
+    int print_stats = 0; /* If set, print mm_stats of each trace (set by -S) */
+
+    char tracedir[MAXLINE] = TRACEDIR;
+
+    /*
+     * Read and interpret the command line arguments
+     */
+    while ((c = getopt(argc, argv, "f:t:cChlLSv")) != EOF) {
+        switch (c) {
+        case 'f': /* Use one specific trace file only (relative to curr dir) */
+            num_tracefiles = 1;
+            if ((tracefiles = realloc(tracefiles, 2*sizeof(char *))) == NULL)
+		unix_error("ERROR: realloc failed in main");
+	    tracedir[0] = '\0'; /* path used as given */
+            tracefiles[0] = strdup(optarg);
+            tracefiles[1] = NULL;
+            break;
+	case 't': /* Directory where the traces are located */
+	    if (num_tracefiles == 1) /* ignore if -f already encountered */
+		break;
+	    strncpy(tracedir, optarg, MAXLINE - 2);
+	    tracedir[MAXLINE - 2] = '\0';
+	    if (tracedir[strlen(tracedir)-1] != '/')
+		strcat(tracedir, "/"); /* path always ends with "/" */
+	    break;
+        case 'c': /* Check the blocks each call changed */
+            check_heap = 1;
+            break;
+        case 'C': /* Check the whole heap after each call */
+            check_heap = 2;
+            break;
+        case 'l': /* Run libc malloc */
+            run_libc = 1;
+            break;
+        case 'L': /* Record latency histograms */
+            run_latency = 1;
+            break;
+        case 'S': /* Print allocator statistics */
+            print_stats = 1;
+            break;
+        case 'v': /* Print progress as traces are read and replayed */
+            verbose = 1;
+            break;
+        case 'h': /* Print this message */
+	    usage();
+            exit(0);
+        default:
+	    usage();
+            exit(1);
+        }
+    }
+
+    /*
+     * If no -f command line arg, then use the entire set of tracefiles
+     * defined in default_traces[]
+     */
+    if (tracefiles == NULL) {
+        tracefiles = default_tracefiles;
+        num_tracefiles = sizeof(default_tracefiles) / sizeof(char *) - 1;
+	printf("Using default tracefiles in %s\n", tracedir);
+    }
+
+    /* Initialize the simulated memory system in memlib.c */
+    mem_init();
+
+    /* Calibrate the timer of the latency histograms */
+    if (run_latency)
+	lat_init();
+
+    /*
+     * Optionally run and evaluate the libc malloc package
+     */
+    if (run_libc) {
+	if (verbose)
+	    printf("\nTesting libc malloc\n");
+
+	/* Allocate libc stats array, with one stats_t struct per tracefile */
+	libc_results = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+	if (libc_results == NULL)
+	    unix_error("libc_results calloc in main failed");
+
+	/* Time the libc malloc package on each trace */
+	for (i=0; i < num_tracefiles; i++) {
+	    trace = read_trace(tracedir, tracefiles[i]);
+	    libc_results[i].ops = trace->num_ops;
+	    if (verbose)
+		printf("Checking libc malloc for speed, ");
+	    libc_results[i].valid = 1;
+	    libc_results[i].secs = eval_libc_speed(trace);
+	    if (run_latency)
+		eval_latency(trace, libc_lat, 1);
+	    free_trace(trace);
+	    if (verbose)
+		printf(" done.\n");
+	}
+
+	/* Display the libc results in a compact table */
+	printresults("Results for libc malloc:", num_tracefiles, libc_results, 0);
+    }
+
+    /*
+     * Always run and evaluate the student's mm package
+     */
+    if (verbose)
+	printf("\nTesting mm malloc\n");
+
+    /* Allocate the mm stats array, with one stats_t struct per tracefile */
+    mm_results = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+    if (mm_results == NULL)
+	unix_error("mm_results calloc in main failed");
+
+    /* Evaluate student's mm malloc package */
+    for (i=0; i < num_tracefiles; i++) {
+	trace = read_trace(tracedir, tracefiles[i]);
+	mm_results[i].ops = trace->num_ops;
+	if (verbose)
+	    printf("Checking mm_malloc for correctness, ");
+	mm_results[i].valid = eval_mm_valid(trace, i);
+	if (mm_results[i].valid) {
+	    if (verbose)
+		printf("efficiency, ");
+	    mm_results[i].util = eval_mm_util(trace, &mm_results[i].heap,
+					    &mm_results[i].sbrks);
+	    if (print_stats) {
+		struct mm_stats st;
+		mm_stats(&st);
+		printf("\nStatistics of mm malloc for %s:\n", tracefiles[i]);
+		mm_stats_print(stdout, &st);
+	    }
+	    if (verbose)
+		printf("and performance.\n");
+	    mm_results[i].secs = eval_mm_speed(trace);
+	    if (run_latency)
+		eval_latency(trace, mm_lat, 0);
+	}
+	free_trace(trace);
+    }
+
+    /* Display the mm results in a compact table */
+    printresults("Results for mm malloc:", num_tracefiles, mm_results, 1);
+
+    /* Display the latency percentiles */
+    if (run_latency) {
+	if (run_libc)
+	    printlatency("Latency of libc malloc (ns):", libc_lat);
+	printlatency("Latency of mm malloc (ns):", mm_lat);
+    }
+
+    /*
+     * Accumulate the aggregate statistics for the student's mm package
+     */
+    double secs = 0, ops = 0, util = 0, libc_secs = 0, libc_ops = 0;
+    int numcorrect = 0;
+    for (i=0; i < num_tracefiles; i++) {
+	secs += mm_results[i].secs;
+	ops += mm_results[i].ops;
+	util += mm_results[i].util;
+	if (mm_results[i].valid)
+	    numcorrect++;
+	if (run_libc) {
+	    libc_secs += libc_results[i].secs;
+	    libc_ops += libc_results[i].ops;
+	}
+    }
+    double avg_mm_util = util/num_tracefiles;
+
+    /*
+     * Compute and print the performance index
+     */
+    if (errors == 0) {
+	double avg_mm_throughput = ops/secs;
+	double ref_throughput = run_libc ? libc_ops/libc_secs : AVG_LIBC_THRUPUT;
+
+	double p1 = UTIL_WEIGHT * avg_mm_util;
+	double p2 = avg_mm_throughput < ref_throughput ?
+	    (1.0-UTIL_WEIGHT) * (avg_mm_throughput/ref_throughput) :
+	    (1.0-UTIL_WEIGHT);
+
+	double perfindex = (p1 + p2)*100.0;
+	printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
+	       p1*100, p2*100, perfindex);
+	printf("Throughput %.0f Kops/sec (%s %.0f Kops/sec)\n",
+	       avg_mm_throughput/1e3, run_libc ? "libc" : "reference",
+	       ref_throughput/1e3);
+    }
+    else { /* There were errors */
+	printf("Terminated with %d errors\n", errors);
+    }
+
+    if (tracefiles != default_tracefiles) {
+	free(tracefiles[0]);
+	free(tracefiles);
+    }
+    free(libc_results);
+    free(mm_results);
+    mem_deinit();
+    exit(errors != 0);
+}
+
+
+/*****************************************************************
+ * The following routines manipulate tracefiles
+ *****************************************************************/
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+static trace_t *read_trace(char *tracedir, char *filename)
+{
+    FILE *tracefile;
+    trace_t *trace;
+    char type[MAXLINE];
+    char path[MAXLINE];
+    unsigned index;
+    size_t size;
+    int sugg_heapsize, weight;
+    int max_index = 0;
+    int op_index;
+
+    if (verbose)
+	printf("Reading tracefile: %s\n", filename);
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+	unix_error("malloc 1 failed in read_trace");
+
+    /* Read the trace file header */
+    snprintf(path, MAXLINE, "%s%s", tracedir, filename);
+    if ((tracefile = fopen(path, "r")) == NULL) {
+	char msg[MAXLINE + 64];
+	snprintf(msg, sizeof(msg), "Could not open %s in read_trace", path);
+	unix_error(msg);
+    }
+    if (fscanf(tracefile, "%d", &sugg_heapsize) != 1 ||  /* not used */
+	fscanf(tracefile, "%d", &trace->num_ids) != 1 ||
+	fscanf(tracefile, "%d", &trace->num_ops) != 1 ||
+	fscanf(tracefile, "%d", &weight) != 1 ||             /* not used */
+	trace->num_ids < 0 || trace->num_ops < 0)
+	app_error("Bogus trace file header in read_trace");
+
+    /* We'll store each request line in the trace in this array */
+    if ((trace->ops =
+	 (traceop_t *)calloc(trace->num_ops + 1, sizeof(traceop_t))) == NULL)
+	unix_error("malloc 2 failed in read_trace");
+
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((trace->blocks =
+	 (char **)calloc(trace->num_ids + 1, sizeof(char *))) == NULL)
+	unix_error("malloc 3 failed in read_trace");
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((trace->block_sizes =
+	 (size_t *)calloc(trace->num_ids + 1, sizeof(size_t))) == NULL)
+	unix_error("malloc 4 failed in read_trace");
+
+    /* ... and the byte each payload is filled with */
+    if ((trace->fills =
+	 (unsigned char *)calloc(trace->num_ids + 1, 1)) == NULL)
+	unix_error("malloc 5 failed in read_trace");
+
+    /* read every request line in the trace file */
+    index = 0;
+    op_index = 0;
+    while (op_index < trace->num_ops && fscanf(tracefile, "%s", type) != EOF) {
+	switch(type[0]) {
+	case 'a':
+	    if (fscanf(tracefile, "%u %zu", &index, &size) != 2)
+		app_error("Bogus alloc request in read_trace");
+	    trace->ops[op_index].type = ALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    break;
+	case 'r':
+	    if (fscanf(tracefile, "%u %zu", &index, &size) != 2)
+		app_error("Bogus realloc request in read_trace");
+	    trace->ops[op_index].type = REALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    break;
+	case 'f':
+	    if (fscanf(tracefile, "%u", &index) != 1)
+		app_error("Bogus free request in read_trace");
+	    trace->ops[op_index].type = FREE;
+	    trace->ops[op_index].index = index;
+	    break;
+	default:
+	    printf("Bogus type character (%c) in tracefile %s\n",
+		   type[0], path);
+	    exit(1);
+	}
+	if (index >= (unsigned)trace->num_ids)
+	    app_error("Block id out of range in read_trace");
+	if ((int)index > max_index)
+	    max_index = index;
+	op_index++;
+    }
+    fclose(tracefile);
+    trace->num_ops = op_index;
+
+    if (verbose)
+	printf("%d ops, %d ids\n", trace->num_ops, max_index + 1);
+    return trace;
+}
+
+/*
+ * free_trace - Free the trace record and the four arrays it points
+ *              to, all of which were allocated in read_trace().
+ */
+static void free_trace(trace_t *trace)
+{
+    free(trace->ops);         /* free the three arrays... */
+    free(trace->blocks);
+    free(trace->block_sizes);
+    free(trace->fills);
+    free(trace);              /* and the trace record itself... */
+}
+
+/**********************************************************************
+ * The following functions evaluate the correctness, space utilization,
+ * and throughput of the libc and mm malloc packages.
+ **********************************************************************/
+
+/*
+ * check_fill - returns 1 if the first size bytes at p all equal fill
+ */
+static int check_fill(char *p, size_t size, unsigned char fill)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+	if ((unsigned char)p[i] != fill)
+	    return 0;
+    return 1;
+}
+
+/*
+ * check_block - check a block returned by mm_malloc or mm_realloc for
+ *     id index: it must be aligned, must not run past the end of the
+ *     heap when it starts inside it (blocks outside of the heap are
+ *     mmapped), must have a usable size of at least size and must not
+ *     overlap any other block still alloc'd.
+ */
+static int check_block(trace_t *trace, int tracenum, int opnum,
+		       char *p, size_t size, int index)
+{
+    char *lo = mem_heap_lo(), *hi = mem_heap_hi();
+    int j;
+
+    if (!IS_ALIGNED(p)) {
+	malloc_error(tracenum, opnum, "Payload address not aligned.");
+	return 0;
+    }
+
+    if (p >= lo && p <= hi && p + size - 1 > hi) {
+	malloc_error(tracenum, opnum, "Payload runs past the end of the heap.");
+	return 0;
+    }
+
+    if (mm_usable_size(p) < size) {
+	malloc_error(tracenum, opnum, "mm_usable_size is below the request size.");
+	return 0;
+    }
+
+    for (j = 0; j < trace->num_ids; j++) {
+	char *q = trace->blocks[j];
+
+	if (j == index || q == NULL)
+	    continue;
+	if (p < q + trace->block_sizes[j] && q < p + size) {
+	    char msg[MAXLINE];
+	    snprintf(msg, MAXLINE, "Payload [%p:%p] overlaps block %d [%p:%p]",
+		     p, p + size - 1, j, q, q + trace->block_sizes[j] - 1);
+	    malloc_error(tracenum, opnum, msg);
+	    return 0;
+	}
+    }
+    return 1;
+}
+
+/*
+ * eval_mm_valid - Check the mm malloc package for correctness. Every
+ *     payload is filled with a byte of its own, which must survive
+ *     until the block is freed, and up to the smaller of the two sizes
+ *     across a realloc.
+ */
+static int eval_mm_valid(trace_t *trace, int tracenum)
+{
+    int i;
+    int index;
+    size_t size, oldsize;
+    char *newp, *oldp, *p;
+
+    /* Reset the heap and free any records in the range list */
+    mem_reset_brk();
+    memset(trace->blocks, 0, trace->num_ids * sizeof(char *));
+    memset(trace->block_sizes, 0, trace->num_ids * sizeof(size_t));
+
+    /* Call the mm package's init function */
+    if (mm_init() < 0) {
+	malloc_error(tracenum, 0, "mm_init failed.");
+	return 0;
+    }
+
+    /* Interpret each operation in the trace in order */
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+
+	    if (trace->blocks[index] != NULL) {
+		malloc_error(tracenum, i, "Trace allocs a block id still in use.");
+		return 0;
+	    }
+
+	    /* Call the student's malloc */
+	    if ((p = mm_malloc(size)) == NULL) {
+		if (size == 0)
+		    break;
+		malloc_error(tracenum, i, "mm_malloc failed.");
+		return 0;
+	    }
+
+	    if (!check_block(trace, tracenum, i, p, size, index))
+		return 0;
+
+	    /* Fill the allocated region with a byte of its own */
+	    trace->fills[index] = (unsigned char)rand();
+	    memset(p, trace->fills[index], size);
+
+	    /* Remember region */
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case REALLOC: /* mm_realloc */
+
+	    /* Call the student's realloc */
+	    oldp = trace->blocks[index];
+	    oldsize = trace->block_sizes[index];
+	    newp = mm_realloc(oldp, size);
+	    if (newp == NULL) {
+		if (size == 0) {
+		    trace->blocks[index] = NULL;
+		    trace->block_sizes[index] = 0;
+		    break;
+		}
+		malloc_error(tracenum, i, "mm_realloc failed.");
+		return 0;
+	    }
+
+	    if (!check_block(trace, tracenum, i, newp, size, index))
+		return 0;
+
+	    /* The old payload must have been copied */
+	    if (!check_fill(newp, oldsize < size ? oldsize : size,
+			    trace->fills[index])) {
+		malloc_error(tracenum, i, "mm_realloc did not preserve the "
+			     "data from old block");
+		return 0;
+	    }
+	    if (size > oldsize)
+		memset(newp + oldsize, trace->fills[index], size - oldsize);
+
+	    /* Remember region */
+	    trace->blocks[index] = newp;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case FREE: /* mm_free */
+
+	    /* The payload must be intact up to the free */
+	    p = trace->blocks[index];
+	    if (p != NULL && !check_fill(p, trace->block_sizes[index],
+					 trace->fills[index])) {
+		malloc_error(tracenum, i, "Payload was overwritten while "
+			     "the block was alloc'd.");
+		return 0;
+	    }
+
+	    mm_free(p);
+	    trace->blocks[index] = NULL;
+	    trace->block_sizes[index] = 0;
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_valid");
+        }
+
+	/* Check the heap after every call if asked to */
+	if (check_heap && (check_heap > 1 ? mm_check() : mm_check_last()) < 0) {
+	    malloc_error(tracenum, i, "mm_check found the heap inconsistent.");
+	    return 0;
+	}
+    }
+
+    /* A full check of the heap the trace leaves */
+    if (check_heap && mm_check() < 0) {
+	malloc_error(tracenum, trace->num_ops, "mm_check found the final heap "
+		     "inconsistent.");
+	return 0;
+    }
+
+    /* As far as we know, this is a valid malloc package */
+    return 1;
+}
+
+/*
+ * eval_mm_util - Evaluate the space utilization of the student's package
+ *   The idea is to remember the high water mark "hwm" of the live
+ *   payload and of the footprint (heap size plus mmapped bytes) during
+ *   the trace, and to return hwm payload / hwm footprint. The peak
+ *   footprint and the number of mem_sbrk calls are returned through
+ *   heap and sbrks.
+ */
+static double eval_mm_util(trace_t *trace, size_t *heap, size_t *sbrks)
+{
+    int i;
+    int index;
+    size_t size, newsize, oldsize;
+    size_t max_total_size = 0;
+    size_t total_size = 0;
+    size_t max_footprint = 0;
+    char *p;
+    char *newp, *oldp;
+
+    /* initialize the heap and the mm malloc package */
+    mem_reset_brk();
+    memset(trace->blocks, 0, trace->num_ids * sizeof(char *));
+    memset(trace->block_sizes, 0, trace->num_ids * sizeof(size_t));
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_util");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_alloc */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+
+	    if ((p = mm_malloc(size)) == NULL && size != 0)
+		app_error("mm_malloc failed in eval_mm_util");
+
+	    /* Remember region and size */
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = p ? size : 0;
+
+	    /* Keep track of current total size
+	     * of all allocated blocks */
+	    total_size += trace->block_sizes[index];
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    index = trace->ops[i].index;
+	    newsize = trace->ops[i].size;
+	    oldsize = trace->block_sizes[index];
+
+	    oldp = trace->blocks[index];
+	    if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0)
+		app_error("mm_realloc failed in eval_mm_util");
+
+	    /* Remember region and size */
+	    trace->blocks[index] = newp;
+	    trace->block_sizes[index] = newp ? newsize : 0;
+
+	    /* Adjust current total size of all allocated blocks */
+	    total_size += trace->block_sizes[index];
+	    total_size -= oldsize;
+	    break;
+
+        case FREE: /* mm_free */
+	    index = trace->ops[i].index;
+	    p = trace->blocks[index];
+
+	    /* Remove region from list and call student's free function */
+	    mm_free(p);
+	    total_size -= trace->block_sizes[index];
+	    trace->blocks[index] = NULL;
+	    trace->block_sizes[index] = 0;
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_util");
+
+        }
+
+	/* update the high water marks */
+	if (total_size > max_total_size)
+	    max_total_size = total_size;
+	if (mem_heapsize() + mm_mmapped() > max_footprint)
+	    max_footprint = mem_heapsize() + mm_mmapped();
+    }
+
+    *heap = max_footprint;
+    *sbrks = mem_sbrk_calls();
+    return max_footprint ? (double)max_total_size / max_footprint : 0;
+}
+
+/*
+ * replay_mm - replay a trace against mm malloc with no checks, freeing
+ *     whatever the trace leaves alloc'd so that no mapping outlives it
+ */
+static void replay_mm(trace_t *trace)
+{
+    int i, index;
+    size_t size;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in replay_mm");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+	switch (trace->ops[i].type) {
+	case ALLOC: /* mm_malloc */
+	    if ((trace->blocks[index] = mm_malloc(size)) == NULL && size != 0)
+		app_error("mm_malloc error in replay_mm");
+	    break;
+	case REALLOC: /* mm_realloc */
+	    if ((trace->blocks[index] = mm_realloc(trace->blocks[index], size))
+		== NULL && size != 0)
+		app_error("mm_realloc error in replay_mm");
+	    break;
+	case FREE: /* mm_free */
+	    mm_free(trace->blocks[index]);
+	    trace->blocks[index] = NULL;
+	    break;
+	default:
+	    app_error("Nonexistent request type in replay_mm");
+	}
+    }
+
+    for (i = 0; i < trace->num_ids; i++) {
+	mm_free(trace->blocks[i]);
+	trace->blocks[i] = NULL;
+    }
+}
+
+/*
+ * replay_libc - replay a trace against the libc malloc package, freeing
+ *     whatever the trace leaves alloc'd
+ */
+static void replay_libc(trace_t *trace)
+{
+    int i, index;
+    size_t size;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+	switch (trace->ops[i].type) {
+	case ALLOC: /* malloc */
+	    if ((trace->blocks[index] = malloc(size)) == NULL && size != 0)
+		unix_error("malloc failed in replay_libc");
+	    break;
+	case REALLOC: /* realloc */
+	    if ((trace->blocks[index] = realloc(trace->blocks[index], size))
+		== NULL && size != 0)
+		unix_error("realloc failed in replay_libc");
+	    break;
+	case FREE: /* free */
+	    free(trace->blocks[index]);
+	    trace->blocks[index] = NULL;
+	    break;
+	default:
+	    app_error("invalid operation type  in replay_libc");
+	}
+    }
+
+    for (i = 0; i < trace->num_ids; i++) {
+	free(trace->blocks[i]);
+	trace->blocks[i] = NULL;
+    }
+}
+
+/*
+ * eval_mm_speed - Return the time in seconds the mm malloc package
+ *     takes to replay a trace
+ */
+static double eval_mm_speed(trace_t *trace)
+{
+    memset(trace->blocks, 0, trace->num_ids * sizeof(char *));
+    return time_replay(replay_mm, trace);
+}
+
+/*
+ * eval_libc_speed - Return the time in seconds the libc malloc package
+ *     takes to replay a trace
+ */
+static double eval_libc_speed(trace_t *trace)
+{
+    memset(trace->blocks, 0, trace->num_ids * sizeof(char *));
+    return time_replay(replay_libc, trace);
+}
+
+/*
+ * time_replay - replay a trace until at least MIN_SPEED_SECS have
+ *     passed and return the average time of one replay
+ */
+static double time_replay(void (*replay)(trace_t *), trace_t *trace)
+{
+    double start, elapsed;
+    long reps = 0;
+
+    replay(trace); /* warm up caches and the heap's pages */
+
+    start = now_secs();
+    do {
+	replay(trace);
+	reps++;
+	elapsed = now_secs() - start;
+    } while (elapsed < MIN_SPEED_SECS);
+
+    return elapsed / reps;
+}
+
+/*
+ * eval_latency - replay a trace once against mm malloc, or libc malloc
+ *     if libc is set, timing every call into the lat histograms of its
+ *     op type and request size. frees count under the size of the
+ *     block freed.
+ */
+static void eval_latency(trace_t *trace, lat_hist_t lat[][LAT_CLASSES + 1],
+			 int libc)
+{
+    int i, index, cls;
+    size_t size;
+    unsigned long long start, ticks;
+    char *p;
+
+    memset(trace->blocks, 0, trace->num_ids * sizeof(char *));
+    memset(trace->block_sizes, 0, trace->num_ids * sizeof(size_t));
+    if (!libc) {
+	mem_reset_brk();
+	if (mm_init() < 0)
+	    app_error("mm_init failed in eval_latency");
+    }
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+	switch (trace->ops[i].type) {
+	case ALLOC: /* malloc */
+	    start = lat_now();
+	    p = libc ? malloc(size) : mm_malloc(size);
+	    ticks = lat_now() - start;
+	    if (p == NULL && size != 0)
+		app_error("malloc failed in eval_latency");
+	    break;
+	case REALLOC: /* realloc */
+	    p = trace->blocks[index];
+	    start = lat_now();
+	    p = libc ? realloc(p, size) : mm_realloc(p, size);
+	    ticks = lat_now() - start;
+	    if (p == NULL && size != 0)
+		app_error("realloc failed in eval_latency");
+	    break;
+	case FREE: /* free */
+	    p = trace->blocks[index];
+	    size = trace->block_sizes[index];
+	    start = lat_now();
+	    if (libc)
+		free(p);
+	    else
+		mm_free(p);
+	    ticks = lat_now() - start;
+	    p = NULL;
+	    break;
+	default:
+	    app_error("Nonexistent request type in eval_latency");
+	}
+
+	trace->blocks[index] = p;
+	trace->block_sizes[index] = p ? size : 0;
+	cls = lat_class(size);
+	lat_record(&lat[trace->ops[i].type][cls], ticks);
+	lat_record(&lat[trace->ops[i].type][LAT_CLASSES], ticks);
+    }
+
+    for (i = 0; i < trace->num_ids; i++) {
+	if (libc)
+	    free(trace->blocks[i]);
+	else
+	    mm_free(trace->blocks[i]);
+	trace->blocks[i] = NULL;
+    }
+}
+
+/*
+ * lat_class - size class of the latency histograms for a request size
+ */
+static int lat_class(size_t size)
+{
+    int cls = 0;
+
+    while (size > lat_class_max[cls])
+	cls++;
+    return cls;
+}
+
+/*
+ * now_secs - current time of the monotonic clock in seconds
+ */
+static double now_secs(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+	unix_error("clock_gettime failed in now_secs");
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*************************************
+ * Some miscellaneous helper routines
+ ************************************/
+
+
+/*
+ * printresults - prints a performance summary. with_mm adds the
+ *     utilization and heap growth columns, which only mm malloc has.
+ */
+static void printresults(char *title, int n, stats_t *stats, int with_mm)
+{
+    int i;
+    double secs = 0;
+    double ops = 0;
+    double util = 0;
+    size_t heap = 0, sbrks = 0;
+
+    printf("\n%s\n", title);
+
+    /* Print the individual results for each trace */
+    printf("%5s%7s %5s%8s%10s%8s", "trace", " valid", "util", "ops", "secs", "Kops");
+    if (with_mm)
+	printf("%10s%7s", "heap KB", "sbrks");
+    printf("\n");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%10s", i, "yes");
+	    if (with_mm)
+		printf("%5.0f%%", stats[i].util*100.0);
+	    else
+		printf("%6s", "-");
+	    printf("%8.0f%10.6f%8.0f",
+		   stats[i].ops,
+		   stats[i].secs,
+		   (stats[i].ops/1e3)/stats[i].secs);
+	    if (with_mm)
+		printf("%10zu%7zu", stats[i].heap / 1024, stats[i].sbrks);
+	    printf("\n");
+	    secs += stats[i].secs;
+	    ops += stats[i].ops;
+	    util += stats[i].util;
+	    heap += stats[i].heap;
+	    sbrks += stats[i].sbrks;
+	}
+	else {
+	    printf("%2d%10s%6s%8s%10s%8s\n",
+		   i,
+		   "no",
+		   "-",
+		   "-",
+		   "-",
+		   "-");
+	}
+    }
+
+    /* Print the aggregate results for the set of traces */
+    if (errors == 0) {
+	printf("%12s", "Total       ");
+	if (with_mm)
+	    printf("%5.0f%%", (util/n)*100.0);
+	else
+	    printf("%6s", "-");
+	printf("%8.0f%10.6f%8.0f",
+	       ops,
+	       secs,
+	       (ops/1e3)/secs);
+	if (with_mm)
+	    printf("%10zu%7zu", heap / 1024, sbrks);
+	printf("\n");
+    }
+    else {
+	printf("%12s%6s%8s%10s%8s\n",
+	       "Total       ",
+	       "-",
+	       "-",
+	       "-",
+	       "-");
+    }
+
+}
+
+/*
+ * printlatency - prints latency percentiles per op type, over all sizes
+ *     and then per request size class
+ */
+static void printlatency(char *title, lat_hist_t lat[][LAT_CLASSES + 1])
+{
+    static char *op_names[LAT_OPS] = { "malloc", "free", "realloc" };
+    int op, cls;
+    char range[32];
+
+    printf("\n%s\n", title);
+    printf("%-8s%-14s%10s%8s%8s%8s%10s\n",
+	   "op", "size", "count", "p50", "p99", "p99.9", "max");
+
+    for (op = 0; op < LAT_OPS; op++) {
+	for (cls = -1; cls < LAT_CLASSES; cls++) {
+	    lat_hist_t *h = &lat[op][cls < 0 ? LAT_CLASSES : cls];
+
+	    if (h->count == 0)
+		continue;
+	    if (cls < 0)
+		snprintf(range, sizeof(range), "all");
+	    else if (cls == LAT_CLASSES - 1)
+		snprintf(range, sizeof(range), ">%zu", lat_class_max[cls - 1]);
+	    else
+		snprintf(range, sizeof(range), "%zu-%zu",
+			 cls ? lat_class_max[cls - 1] + 1 : 1, lat_class_max[cls]);
+	    printf("%-8s%-14s%10llu%8.0f%8.0f%8.0f%10.0f\n",
+		   cls < 0 ? op_names[op] : "", range, h->count,
+		   lat_percentile_ns(h, 50), lat_percentile_ns(h, 99),
+		   lat_percentile_ns(h, 99.9), lat_ns(h->max));
+	}
+    }
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    printf("%s\n", msg);
+    exit(1);
+}
+
+/*
+ * unix_error - Report a Unix-style error
+ */
+static void unix_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * malloc_error - Report an error returned by the mm_malloc package
+ */
+static void malloc_error(int tracenum, int opnum, char *msg)
+{
+    errors++;
+    printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum), msg);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mdriver [-cChlLSv] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-c         Check the blocks each call changed (mm_check_last).\n");
+    fprintf(stderr, "\t-C         Check the whole heap after each call (mm_check).\n");
+    fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Print latency percentiles of every call.\n");
+    fprintf(stderr, "\t-S         Print allocator statistics of every trace.\n");
+    fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-v         Print progress as traces are replayed.\n");
+}
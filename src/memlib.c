@@ -1,6 +1,12 @@
 /*
  * memlib.c - a module that simulates the memory system.  Needed because it 
  * allows mm.c to interleave calls with the system's malloc package in libc.
+ *
+ * Each heap is a region: a single PROT_NONE reservation of max_heap bytes
+ * of address space. mem_region_sbrk commits the pages under the new brk as
+ * it grows and mem_region_shrink_brk decommits the pages above it, so the
+ * resident size of a heap follows its brk rather than the reservation.
+ * The mem_* functions operate on a default region, set up by mem_init.
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,27 +20,210 @@
 #include "config.h"
 
 #define ALIGNMENT 8  
-#define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#ifndef MAX_HEAP
+#define MAX_HEAP ((size_t)1 << (sizeof(void *) == 4 ? 28 : 32))  /* 256 MB / 4 GB */
+#endif
 
 
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static struct mem_region mem_default;  /* region of the mem_* functions */
+
+static void mem_decommit(struct mem_region *r, char *addr);
+
+/* 
+ * mem_region_init - initialize region r with room for a heap of up to
+ *    max_heap bytes. Only address space is reserved here. Returns 0, or
+ *    -1 if the address space could not be reserved.
+ */
+int mem_region_init(struct mem_region *r, size_t max_heap)
+{
+    size_t page = mem_pagesize();
+
+    max_heap = (max_heap + page - 1) & ~(page - 1);
+
+    /* reserve the address space we will use to model the available VM */
+    r->start_brk = mmap(NULL, max_heap, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (r->start_brk == MAP_FAILED)
+	return -1;
+
+    r->max_addr = r->start_brk + max_heap;  /* max legal heap address */
+    r->brk = r->start_brk;                  /* heap is empty initially */
+    r->commit_brk = r->start_brk;           /* nothing committed yet */
+    r->sbrk_count = 0;
+    return 0;
+}
+
+/* 
+ * mem_region_deinit - release the address space of region r
+ */
+void mem_region_deinit(struct mem_region *r)
+{
+    munmap(r->start_brk, (size_t)(r->max_addr - r->start_brk));
+}
+
+/*
+ * mem_region_reset_brk - reset the brk pointer of region r to make an
+ *    empty heap
+ */
+void mem_region_reset_brk(struct mem_region *r)
+{
+    r->brk = r->start_brk;
+    mem_decommit(r, r->start_brk);
+    r->sbrk_count = 0;
+}
+
+/* 
+ * mem_region_sbrk - simple model of the sbrk function. Extends the heap
+ *    of region r by incr bytes and returns the start address of the new
+ *    area, committing the pages it covers. The heap is shrunk with
+ *    mem_region_shrink_brk.
+ */
+void *mem_region_sbrk(struct mem_region *r, size_t incr) 
+{
+    char *old_brk = r->brk;
+
+    if (incr > (size_t)(r->max_addr - r->brk)) {
+	errno = ENOMEM;
+	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+
+    if (r->brk + incr > r->commit_brk) {
+	size_t page = mem_pagesize();
+	char *commit = r->start_brk +
+	    ((size_t)(r->brk + incr - r->start_brk + page - 1) & ~(page - 1));
+
+	if (mprotect(r->commit_brk, (size_t)(commit - r->commit_brk),
+		     PROT_READ | PROT_WRITE) < 0) {
+	    fprintf(stderr, "ERROR: mem_sbrk failed. Could not commit pages...\n");
+	    return (void *)-1;
+	}
+	r->commit_brk = commit;
+    }
+
+    r->brk += incr;
+    r->sbrk_count++;
+    return (void *)old_brk;
+}
+
+/*
+ * mem_region_shrink_brk - model of sbrk with a negative increment.
+ *    Shrinks the heap of region r by decr bytes and returns the old end
+ *    of the heap. Pages wholly above the new end are decommitted, so the
+ *    released bytes must no longer be in use.
+ */
+void *mem_region_shrink_brk(struct mem_region *r, size_t decr)
+{
+    char *old_brk = r->brk;
+
+    if (decr > (size_t)(r->brk - r->start_brk)) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_shrink_brk failed. Heap is smaller than decrement...\n");
+	return (void *)-1;
+    }
+    r->brk -= decr;
+    mem_decommit(r, r->brk);
+    return (void *)old_brk;
+}
+
+/*
+ * mem_decommit - give the pages of region r from the one holding addr
+ *    (exclusive, unless addr is page aligned) up to the committed end
+ *    back to the system and make them inaccessible again
+ */
+static void mem_decommit(struct mem_region *r, char *addr)
+{
+    size_t page = mem_pagesize();
+    char *start = r->start_brk +
+	((size_t)(addr - r->start_brk + page - 1) & ~(page - 1));
+
+    if (start >= r->commit_brk)
+	return;
+
+    madvise(start, (size_t)(r->commit_brk - start), MADV_DONTNEED);
+    mprotect(start, (size_t)(r->commit_brk - start), PROT_NONE);
+    r->commit_brk = start;
+}
+
+/*
+ * mem_region_heap_lo - return address of the first heap byte of region r
+ */
+void *mem_region_heap_lo(struct mem_region *r)
+{
+    return (void *)r->start_brk;
+}
 
 /* 
- * mem_init - initialize the memory system model
+ * mem_region_heap_hi - return address of last heap byte of region r
+ */
+void *mem_region_heap_hi(struct mem_region *r)
+{
+    return (void *)(r->brk - 1);
+}
+
+/*
+ * mem_region_heapsize() - returns the heap size of region r in bytes
+ */
+size_t mem_region_heapsize(struct mem_region *r) 
+{
+    return (size_t)(r->brk - r->start_brk);
+}
+
+/*
+ * mem_region_committed() - returns the bytes of committed (accessible)
+ *    heap pages of region r, which is the heap size rounded up to a page
+ */
+size_t mem_region_committed(struct mem_region *r)
+{
+    return (size_t)(r->commit_brk - r->start_brk);
+}
+
+/*
+ * mem_region_maxheap() - returns the largest size the heap of region r
+ *    can grow to
+ */
+size_t mem_region_maxheap(struct mem_region *r)
+{
+    return (size_t)(r->max_addr - r->start_brk);
+}
+
+/*
+ * mem_region_sbrk_calls() - returns the number of successful sbrk calls
+ *    on region r since it was last initialized or reset
+ */
+size_t mem_region_sbrk_calls(struct mem_region *r)
+{
+    return r->sbrk_count;
+}
+
+/*
+ * mem_default_region() - returns the region of the mem_* functions
+ */
+struct mem_region *mem_default_region()
+{
+    return &mem_default;
+}
+
+/* 
+ * mem_init - initialize the memory system model with the default
+ *    maximum heap size
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    mem_init_max(MAX_HEAP);
+}
+
+/* 
+ * mem_init_max - initialize the memory system model with room for a
+ *    heap of up to max_heap bytes
+ */
+void mem_init_max(size_t max_heap)
+{
+    if (mem_region_init(&mem_default, max_heap) < 0) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
-
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
 }
 
 /* 
@@ -42,7 +231,7 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    mem_region_deinit(&mem_default);
 }
 
 /*
@@ -50,25 +239,24 @@ void mem_deinit(void)
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    mem_region_reset_brk(&mem_default);
 }
 
 /* 
- * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ * mem_sbrk - extend the default heap by incr bytes, see mem_region_sbrk
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(size_t incr) 
 {
-    char *old_brk = mem_brk;
+    return mem_region_sbrk(&mem_default, incr);
+}
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
-	errno = ENOMEM;
-	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
-	return (void *)-1;
-    }
-    mem_brk += incr;
-    return (void *)old_brk;
+/*
+ * mem_shrink_brk - shrink the default heap by decr bytes, see
+ *    mem_region_shrink_brk
+ */
+void *mem_shrink_brk(size_t decr)
+{
+    return mem_region_shrink_brk(&mem_default, decr);
 }
 
 /*
@@ -76,7 +264,7 @@ void *mem_sbrk(int incr)
  */
 void *mem_heap_lo()
 {
-    return (void *)mem_start_brk;
+    return mem_region_heap_lo(&mem_default);
 }
 
 /* 
@@ -84,7 +272,7 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return mem_region_heap_hi(&mem_default);
 }
 
 /*
@@ -92,7 +280,32 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return mem_region_heapsize(&mem_default);
+}
+
+/*
+ * mem_committed() - returns the bytes of committed heap pages
+ */
+size_t mem_committed()
+{
+    return mem_region_committed(&mem_default);
+}
+
+/*
+ * mem_maxheap() - returns the largest size the heap can grow to
+ */
+size_t mem_maxheap()
+{
+    return mem_region_maxheap(&mem_default);
+}
+
+/*
+ * mem_sbrk_calls() - returns the number of successful mem_sbrk calls
+ *    since the heap was last initialized or reset
+ */
+size_t mem_sbrk_calls()
+{
+    return mem_region_sbrk_calls(&mem_default);
 }
 
 /*
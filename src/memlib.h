@@ -1,11 +1,41 @@
 #include <unistd.h>
 
+/*
+ * a simulated heap: one reservation of address space with a brk that
+ * moves within it. the mem_region_* functions work on any region, the
+ * plain mem_* functions on the default region set up by mem_init.
+ */
+struct mem_region {
+    char *start_brk;     /* points to first byte of heap */
+    char *brk;           /* points to last byte of heap */
+    char *max_addr;      /* largest legal heap address */
+    char *commit_brk;    /* end of committed pages, page aligned */
+    size_t sbrk_count;   /* successful sbrk calls since reset */
+};
+
+int mem_region_init(struct mem_region *r, size_t max_heap);
+void mem_region_deinit(struct mem_region *r);
+void *mem_region_sbrk(struct mem_region *r, size_t incr);
+void *mem_region_shrink_brk(struct mem_region *r, size_t decr);
+void mem_region_reset_brk(struct mem_region *r);
+void *mem_region_heap_lo(struct mem_region *r);
+void *mem_region_heap_hi(struct mem_region *r);
+size_t mem_region_heapsize(struct mem_region *r);
+size_t mem_region_committed(struct mem_region *r);
+size_t mem_region_maxheap(struct mem_region *r);
+size_t mem_region_sbrk_calls(struct mem_region *r);
+struct mem_region *mem_default_region(void);
+
 void mem_init(void);               
+void mem_init_max(size_t max_heap);
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(size_t incr);
+void *mem_shrink_brk(size_t decr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_committed(void);
+size_t mem_maxheap(void);
+size_t mem_sbrk_calls(void);
 size_t mem_pagesize(void);
-
@@ -1,18 +1,93 @@
 /*
  * mm.c - simple light-weight memory allocation package. implementation based on first fit
  * search of a segregated fits table. seg_lists (segregated fits table header) is an array
- * of ptrs to linkedlists of free blocks for each size class. each ptr can be a null ref or a
- * memory address of the next n+1 free block's payload. storing addresses in payload requires a
- * 16 byte block size (including 4 byte header and 4 byte footer). table lookup is based on naive
- * hash to find ideal class size. from this point classes are traversed until first fit is found.
+ * of links to doubly linked lists of free blocks for each size class. each link can be a null ref
+ * or the location of the first free block's payload. a free block's payload holds links to the
+ * next and previous free block of its class, so a block is unlinked in constant time. links are
+ * stored as 32 bit offsets from mem_hp (0 being null, as mem_hp is never free) so that the same
+ * layout serves 32 and 64 bit builds. a free block holds a 4 byte header, both links and a
+ * 4 byte footer, which makes 16 bytes the minimum block size. an alloc'd block has a header
+ * only: each header records in PREV_ALLOC whether the block before it is alloc'd, so the
+ * footer is only read to step back to a free block, and an alloc'd block's payload runs up
+ * to the next header. size classes are geometric: each power of two is split into
+ * SEG_SUBCLASSES equal sub-classes, so a class only holds blocks of comparable size. table
+ * lookup finds the ideal class from the block size's leading bits, and the search goes on
+ * from there to the first fit of a list, or the best fit of a size tree (see below).
+ * seg_bitmap marks the non empty classes, so that a find first set skips to the next one
+ * instead of visiting empty lists.
  * this strategy combined with block splitting leads to high throughput and utilization performance
  * of a best bit strategy.
  *
+ * classes from SEG_TREE_CLASS on, by default the last one, which holds every size above the
+ * others, keep a size tree instead of a list: a bitwise trie on block size whose nodes are
+ * the free blocks themselves, with blocks of equal size chained off one node. it gives the
+ * best fit of the class in a walk bounded by the bits of a size rather than by the number
+ * of free blocks (see tree_insert and tree_fit). its root takes the class's seg_lists head.
+ *
+ * a build with MM_TLSF set uses the TLSF engine (two-level segregated fit) instead, for
+ * callers that need a bound on the time of each call: the classes extend to MAX_BLOCK_SIZE,
+ * so none holds blocks of unbounded size and there are no size trees. a first level bitmap
+ * marks the powers of two with a non empty class and a second level bitmap per power of two
+ * marks its sub-classes (see class_find). get_fit takes the first block of the first non
+ * empty class whose blocks all fit, so that a search is two find first sets, not a walk.
+ * the work that batches frees of other calls into one, the thread caches, remote queues and
+ * quick lists, is off by default in this build, so that no call pays for blocks others freed.
+ *
+ * requests of mmap_threshold bytes or more bypass the heap: each gets its own anonymous
+ * mapping, marked by MMAP_BIT in its header, which is unmapped on free and resized with
+ * mremap on realloc. mmap_threshold follows the size of freed mappings, so sizes that are
+ * allocated and freed repeatedly move back to the heap.
+ *
+ * all state of a heap lives in a struct mm_heap over a memlib region of its own, so heaps
+ * are independent of each other. mm_malloc and friends work on a static default heap over
+ * memlib's default region; mm_heap_create builds further heaps that mm_heap_malloc and
+ * friends work on, and mm_heap_destroy releases one with everything alloc'd from it.
+ *
+ * each heap has a mutex that every public call holds. mm_malloc and friends spread threads
+ * over arenas: the default heap is arena 0 and further arenas are heaps over regions of
+ * their own, created as threads get assigned to them. a thread allocs from its arena and
+ * moves to the next one when it keeps finding the arena's lock taken. blocks are freed to
+ * the arena they came from, which is found from the block's address in the page map.
+ *
+ * the page map is a three level radix tree over the address space with an entry for every
+ * page a heap hands out: the heap that owns the page, and whether the page holds heap blocks,
+ * a slab run or the start of an mmapped block. heaps fill in their pages as they grow, map
+ * blocks or make runs, and lookups read it without locking (see pagemap_get), so mm_free and
+ * mm_usable_size find what they need from a pointer in three dependent loads.
+ *
+ * in front of the arenas, each thread keeps a cache of recently freed small blocks (tcache)
+ * in bins of one payload size each, which mm_malloc and mm_free use without locking. a thread
+ * refills an empty bin from its arena and flushes a full one to the owning arenas in batches
+ * under a single lock. cached blocks stay marked alloc'd in their heap, so coalescing and
+ * mm_check do not see them.
+ *
+ * behind the tcache, each heap keeps quick lists of freed blocks of up to QUICK_MAX bytes, one
+ * list per block size. heap_free pushes such a block there as it is, still marked alloc'd and
+ * without coalescing, and heap_malloc pops a block of the exact size before searching
+ * seg_lists, so that a size freed and alloc'd again is neither merged nor split. coalescing is
+ * deferred to consolidate, which frees every quick block in one pass: when a request misses
+ * seg_lists and would grow the heap, when a realloc cannot resize in place, when the quick lists
+ * pass QUICK_BYTES, and before a trim. a block that realloc moves away from is coalesced at once.
+ *
+ * a thread freeing a block of another arena does not lock it: the block is pushed on the
+ * arena's remote queue, a lock-free stack that every call taking the arena's lock drains and
+ * frees in one batch (see remote_free and heap_lock), as does a thread that exits. until then
+ * queued blocks count as alloc'd. blocks of heaps from mm_heap_create are never queued.
+ *
+ * requests of up to SLAB_MAX bytes are served from slab runs instead of blocks of their own:
+ * a run is a heap block of RUN_SIZE bytes whose payload starts on a RUN_SIZE boundary (its
+ * footer and the next block's header take the last bytes before the next boundary, so runs
+ * in a row tile pages exactly). it holds objects of one size class without headers or
+ * footers: the object size is kept once in the run's struct slab_run, and free objects are
+ * linked through their first word. the page map tells run pages apart, so that free and
+ * realloc find the run of an object (see is_run). to the rest of the heap a run is an alloc'd
+ * block like any other.
+ *
  * e.g.
  *
  * seg_lists
  * -------------------------------------------------------------------
- * |seg_lists[0]:class 1 ---> free block 1 ---> free block n ---> 0
+ * |seg_lists[0]:class 1 <--> free block 1 <--> free block n ---> 0
  * -------------------------------------------------------------------
  * |....
  * -------------------------------------------------------------------
@@ -21,11 +96,15 @@
  *
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "mm.h"
 #include "memlib.h"
@@ -34,362 +113,3263 @@
 #define WSIZE 			4
 #define DSIZE 			8
 #define ALIGNMENT		8
-#define CHUNKSIZE		( 1 << 12 )
 #define MIN_BLOCK_SIZE  	( 2 * DSIZE )
-#define SEG_LIST_COUNT		8
+#define MIN_BLOCK_SHIFT		4
+#define MAX_BLOCK_SIZE		( ~0x7U )	//largest size a 4 byte header holds
+#define PREV_ALLOC		0x4	//header bit set when the previous block is alloc'd
+
+//SIZE CLASSES
+#ifndef MM_TLSF
+#define MM_TLSF			0	//1 selects the TLSF engine, good fit in constant time
+#endif
+#ifndef SEG_CLASS_BITS
+#define SEG_CLASS_BITS		2	//log2 of sub-classes per power of two
+#endif
+#define SEG_SUBCLASSES		( 1 << SEG_CLASS_BITS )
+#define SEG_ALL_CLASSES		( ( 32 - MIN_BLOCK_SHIFT ) << SEG_CLASS_BITS )	//classes up to MAX_BLOCK_SIZE
+#ifndef SEG_LIST_COUNT
+#define SEG_LIST_COUNT		( MM_TLSF ? SEG_ALL_CLASSES : 64 )
+#endif
+#define SEG_FL_COUNT		( ( SEG_LIST_COUNT + SEG_SUBCLASSES - 1 ) >> SEG_CLASS_BITS )	//first levels, TLSF
+#ifndef SEG_TREE_CLASS
+#define SEG_TREE_CLASS		( MM_TLSF ? SEG_LIST_COUNT : SEG_LIST_COUNT - 1 )	//first class kept in size trees, SEG_LIST_COUNT for none
+#endif
+
+//HEAP GROWTH
+#ifndef CHUNKSIZE
+#define CHUNKSIZE		( 1 << 12 )	//least bytes grow_heap asks mem_sbrk for
+#endif
+#ifndef GROW_SHIFT
+#define GROW_SHIFT		3	//grow by at least heap size >> GROW_SHIFT
+#endif
+
+//HEAP TRIMMING
+#ifndef TRIM_THRESHOLD
+#define TRIM_THRESHOLD		( 1 << 17 )	//free tail size that triggers a trim
+#endif
+#ifndef TOP_PAD
+#define TOP_PAD			( 1 << 16 )	//free tail bytes kept by a trim
+#endif
+
+//MMAP CHUNKS
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD		( 1 << 17 )	//initial request size served by mmap
+#endif
+#ifndef MMAP_THRESHOLD_MAX
+#define MMAP_THRESHOLD_MAX	( 4 * 1024 * 1024 * sizeof( long ) )	//cap of dynamic threshold
+#endif
+#define MMAP_BIT		0x2
+#define MMAP_HEADER_SIZE	ALIGN( sizeof( struct mmap_chunk ) + WSIZE )	//chunk, pad and header
+
+//STATISTICS
+#ifndef MM_STATS
+#define MM_STATS		1	//0 compiles the counters of mm_stats out
+#endif
+
+//ARENAS
+#ifndef MM_ARENAS
+#define MM_ARENAS		0	//arenas of mm_malloc etc., 0 for 4 per online cpu
+#endif
+//8 with 32 bit pointers, where 64 regions of ARENA_SIZE would fill the address space
+#define ARENAS_MAX		( __SIZEOF_POINTER__ == 4 ? 8 : 64 )
+#ifndef ARENA_SIZE
+#define ARENA_SIZE		( (size_t)1 << ( sizeof( void* ) == 4 ? 26 : 32 ) )	//address space reserved by an arena
+#endif
+#ifndef ARENA_BY_CPU
+#define ARENA_BY_CPU		0	//1 assigns threads to arenas by cpu, 0 round-robin
+#endif
+#ifndef ARENA_CONTENTION
+#define ARENA_CONTENTION	16	//contention score that moves a thread to the next arena
+#endif
+
+#ifndef MM_REMOTE_FREE
+#define MM_REMOTE_FREE		( !MM_TLSF )	//0 frees blocks of other arenas under their lock, as MM_TLSF does
+#endif
+
+//PAGE MAP
+#define PAGEMAP_SHIFT		12	//log2 of the page size the page map tracks
+#define PAGEMAP_BITS		( ( sizeof( void* ) == 4 ? 32 : 48 ) - PAGEMAP_SHIFT )	//page number bits
+#define PAGEMAP_LEAF_BITS	( PAGEMAP_BITS / 3 )
+#define PAGEMAP_MID_BITS	( PAGEMAP_BITS / 3 )
+#define PAGEMAP_ROOT_BITS	( PAGEMAP_BITS - PAGEMAP_MID_BITS - PAGEMAP_LEAF_BITS )
+#define PAGE_BLOCKS		1	//page of heap blocks
+#define PAGE_RUN		2	//page of a slab run
+#define PAGE_MMAP		3	//first page of an mmapped block
+
+//SLAB RUNS
+#ifndef MM_SLAB
+#define MM_SLAB			1	//0 serves small requests from blocks of their own
+#endif
+#ifndef SLAB_MAX
+#define SLAB_MAX		32	//largest request served from slab runs
+#endif
+#define SLAB_CLASSES		( SLAB_MAX / ALIGNMENT )
+#define RUN_SIZE		( 1 << PAGEMAP_SHIFT )	//block size and payload alignment of a run, one page
+#define RUN_HEADER_SIZE		64	//struct slab_run and pad, objects follow
+
+//THREAD CACHE
+#ifndef MM_TCACHE
+#define MM_TCACHE		( !MM_TLSF )	//0 sends every call to the locked heap, as MM_TLSF does
+#endif
+#ifndef TCACHE_MAX
+#define TCACHE_MAX		512	//largest request size served by thread caches
+#endif
+#ifndef TCACHE_COUNT
+#define TCACHE_COUNT		16	//blocks kept per bin
+#endif
+#ifndef TCACHE_BYTES
+#define TCACHE_BYTES		( 1 << 15 )	//bytes kept per thread
+#endif
+#ifndef TCACHE_GC_OPS
+#define TCACHE_GC_OPS		1024	//calls between two gc steps of a thread cache
+#endif
+#define TCACHE_BATCH		( TCACHE_COUNT / 2 )	//blocks moved by a refill or flush
+
+//QUICK LISTS
+#ifndef MM_QUICK
+#define MM_QUICK		( !MM_TLSF )	//0 coalesces every freed block at once, as MM_TLSF does
+#endif
+#ifndef QUICK_MAX
+#define QUICK_MAX		256	//largest block size kept on quick lists
+#endif
+#ifndef QUICK_BYTES
+#define QUICK_BYTES		( 1 << 16 )	//bytes on quick lists that trigger a consolidation
+#endif
+#define QUICK_LISTS		( ( QUICK_MAX - MIN_BLOCK_SIZE ) / ALIGNMENT + 1 )
+
+#if TOP_PAD >= TRIM_THRESHOLD
+#error "TOP_PAD must be below TRIM_THRESHOLD"
+#endif
+#if SEG_CLASS_BITS > MIN_BLOCK_SHIFT
+#error "SEG_CLASS_BITS must not exceed MIN_BLOCK_SHIFT"
+#endif
+#if !MM_TLSF && SEG_LIST_COUNT > 64
+#error "SEG_LIST_COUNT must fit in the seg_bitmap word"
+#endif
+#if MM_TLSF && ( SEG_LIST_COUNT != SEG_ALL_CLASSES || SEG_TREE_CLASS != SEG_LIST_COUNT )
+#error "MM_TLSF needs a list class for every block size and no size trees"
+#endif
+#if SEG_LIST_COUNT > MM_STATS_CLASSES
+#error "SEG_LIST_COUNT must not exceed MM_STATS_CLASSES"
+#endif
+#if SEG_TREE_CLASS < SEG_SUBCLASSES || SEG_TREE_CLASS > SEG_LIST_COUNT
+#error "SEG_TREE_CLASS must be in SEG_SUBCLASSES..SEG_LIST_COUNT, its blocks hold 5 links"
+#endif
+#if MM_ARENAS < 0 || MM_ARENAS > ARENAS_MAX
+#error "MM_ARENAS must be in 0..ARENAS_MAX"
+#endif
+#if TCACHE_MAX % ALIGNMENT || TCACHE_MAX < ALIGNMENT
+#error "TCACHE_MAX must be a multiple of ALIGNMENT"
+#endif
+#if QUICK_MAX % ALIGNMENT || QUICK_MAX < MIN_BLOCK_SIZE
+#error "QUICK_MAX must be a multiple of ALIGNMENT and at least MIN_BLOCK_SIZE"
+#endif
+#if SLAB_MAX % ALIGNMENT || SLAB_MAX < ALIGNMENT || 8 * SLAB_MAX > RUN_SIZE - RUN_HEADER_SIZE - WSIZE
+#error "SLAB_MAX must be a multiple of ALIGNMENT, with 8 objects to a run"
+#endif
 
 //MACROS
 #define MAX( x, y ) 		( ( x ) > ( y ) ? ( x ) : ( y ) )
+#define MIN( x, y ) 		( ( x ) < ( y ) ? ( x ) : ( y ) )
 #define ALIGN( size ) 		( ( ( size ) + ( ALIGNMENT-1 ) ) & ~0x7 )
 #define PACK( size, alloc ) 	( ( size ) | ( alloc ) )
 
 #define GET( p )		( *( unsigned int*)( p ) )
 #define PUT( p, val ) 		( *(unsigned int*)( p ) = ( val ) )
-#define GET_PTR_ADDR( p )	( *( unsigned int**)( p ) )
-#define PUT_PTR_ADDR( p, val )	( *( unsigned int**)( p ) = ( val ) )
+#define GET_LINK( h, p )	( GET( p ) ? ( h )->mem_hp + GET( p ) : NULL )
+#define PUT_LINK( h, p, val )	PUT( p, ( val ) ? (unsigned int)( (char*)( val ) - ( h )->mem_hp ) : 0 )
 
 #define GET_SIZE( p )		( GET( p ) & ~0x7 )
 #define GET_ALLOC( p )		( GET( p ) & 0x1 )
-#define SIZE_T_SIZE 		( ALIGN( sizeof( size_t ) ) )
+#define GET_MMAPPED( p )	( GET( p ) & MMAP_BIT )
+#define GET_PREV_ALLOC( p )	( GET( p ) & PREV_ALLOC )
+#define GET_ATOMIC( p )		__atomic_load_n( (unsigned int*)( p ), __ATOMIC_RELAXED )
+#define PUT_ATOMIC( p, val )	__atomic_store_n( (unsigned int*)( p ), val, __ATOMIC_RELAXED )
+#define SET_PREV_ALLOC( p )	PUT_ATOMIC( p, GET( p ) | PREV_ALLOC )	//see block_usable
+#define CLEAR_PREV_ALLOC( p )	PUT_ATOMIC( p, GET( p ) & ~PREV_ALLOC )
 
 #define GET_HEADER( p )		( (char*)( p ) - WSIZE )
 #define GET_FOOTER( p )		( (char*)( p ) + GET_SIZE( GET_HEADER( p ) ) - DSIZE )
-#define GET_NEXT(p)		( (char*)( p ) + GET_SIZE( ( (char*)( p - WSIZE ) ) ) )
-#define GET_PREV(p)		( (char*)( p ) - GET_SIZE( ( (char*)( p - DSIZE ) ) ) )
+#define GET_NEXT(p)		( (char*)( p ) + GET_SIZE( (char*)( p ) - WSIZE ) )
+#define GET_PREV(p)		( (char*)( p ) - GET_SIZE( (char*)( p ) - DSIZE ) )	//previous block must be free
+#define IS_LAST(p)		( GET_SIZE( GET_HEADER( GET_NEXT( p ) ) ) == 0 )
+#define MMAP_CHUNK(p)		( (struct mmap_chunk*)( (char*)( p ) - MMAP_HEADER_SIZE ) )
+#define MMAP_PAYLOAD(c)		( (char*)( c ) + MMAP_HEADER_SIZE )
+
+#define GET_NEXT_FREE(h, p) 	GET_LINK( h, (char*)( p ) )
+#define GET_PREV_FREE(h, p) 	GET_LINK( h, (char*)( p ) + WSIZE )
+#define PUT_NEXT_FREE(h, p, val) 	PUT_LINK( h, (char*)( p ), val )
+#define PUT_PREV_FREE(h, p, val) 	PUT_LINK( h, (char*)( p ) + WSIZE, val )
+#define SEG_LIST_HEAD(h, i)	( ( h )->seg_lists + ( WSIZE * ( i ) ) )
+#define SEG_BIT(i)		( 1ULL << ( i ) )
+#define TREE_LINK(h, p, f)	GET_LINK( h, (char*)( p ) + WSIZE * ( f ) )
+#define PUT_TREE_LINK(h, p, f, val)	PUT_LINK( h, (char*)( p ) + WSIZE * ( f ), val )
+#define TREE_FD			0	//link to next block of the same size
+#define TREE_BK			1	//link to previous block of the same size
+#define TREE_CHILD(b)		( 2 + ( b ) )	//links to the subtrees of bit b
+#define TREE_PARENT		4	//link to parent node, 0 for the root and chained blocks
+#define TREE_BIT(key, depth)	( ( key ) >> ( 31 - ( depth ) ) & 1 )
+#define INSIDE_HEAP(h, p)	( (void*)( p ) >= (void*)( h )->mem_hp && (void*)( p ) < (void*)( h )->mem_bp )
+#define PAYLOAD_SIZE(p)		( GET_MMAPPED( GET_HEADER( p ) ) ? MMAP_CHUNK( p )->len - MMAP_HEADER_SIZE : GET_SIZE( GET_HEADER( p ) ) - WSIZE )
+
+#define SLAB_CLASS(size)	( ALIGN( size ) / ALIGNMENT - 1 )
+#define SLAB_NEXT(p)		( *(void**)( p ) )
+#define RUN_OF(p)		( (struct slab_run*)( (unsigned long)( p ) & ~( RUN_SIZE - 1UL ) ) )
+
+#define PAGEMAP_SIZE(bits)	( (size_t)1 << ( bits ) )
+#define PAGE_OF(p)		( (unsigned long)( p ) >> PAGEMAP_SHIFT )
+#define PAGE_ENTRY(h, kind)	( (unsigned long)( h ) | ( kind ) )
+#define PAGE_KIND(e)		( ( e ) & 0x3 )
+#define PAGE_OWNER(e)		( (struct mm_heap*)( ( e ) & ~0x3UL ) )
+
+#define TCACHE_BINS		( TCACHE_MAX / WSIZE + 1 )	//payloads up to TCACHE_MAX + WSIZE
+#define TCACHE_BIN(usable)	( ( usable ) / WSIZE - 1 )
+#define TCACHE_SIZE(bin)	( ( ( bin ) + 1 ) * WSIZE )
+#define TCACHE_NEXT(p)		( *(void**)( p ) )
+#define REMOTE_NEXT(p)		( *(void**)( p ) )
+#define QUICK_LIST(size)	( ( ( size ) - MIN_BLOCK_SIZE ) / ALIGNMENT )
+#define QUICK_NEXT(p)		( *(void**)( p ) )
+
+#if MM_STATS
+#define STAT(h, field, n)	( ( h )->stats.field += ( n ) )
+#define STAT_LIVE(h, n)		( ( h )->stats.live_bytes += ( n ), \
+				  ( h )->stats.peak_bytes = MAX( ( h )->stats.peak_bytes, ( h )->stats.live_bytes ) )
+#else
+#define STAT(h, field, n)	( (void)0 )
+#define STAT_LIVE(h, n)		( (void)0 )
+#endif
+
+//TYPES
+/*
+ * mmap_chunk - start of the mapping of an mmapped block. mappings of a
+ * heap are kept on a list so that mm_heap_destroy can unmap them.
+ */
+struct mmap_chunk {
+  struct mmap_chunk *next;
+  struct mmap_chunk *prev;
+  size_t len;			//mapping length
+  struct mm_heap *heap;		//heap of the block, see arena_of
+};
+
+/*
+ * slab_run - start of a run, the payload of a heap block that holds count
+ * objects of size bytes from RUN_HEADER_SIZE on, up to the block's footer.
+ * objects are handed out from free, or from the never used tail of the
+ * run while carved is below count. runs with free objects are linked on
+ * the runs list of their class; full runs are on no list.
+ */
+struct slab_run {
+  struct slab_run *next;
+  struct slab_run *prev;
+  void *free;			//freed objects, linked through their first word
+  unsigned int size;		//object size
+  unsigned int count;		//objects in the run
+  unsigned int used;		//objects alloc'd
+  unsigned int carved;		//objects handed out at least once
+};
+
+_Static_assert( sizeof( struct slab_run ) <= RUN_HEADER_SIZE, "RUN_HEADER_SIZE must hold struct slab_run" );
+
+/*
+ * mm_heap - state of one heap. each heap allocates from its own memlib
+ * region. mm_heap_create places the heap in the first bytes of its region;
+ * the default heap, arena 0 of mm_malloc etc., is a static instance over
+ * memlib's default region. entries of the page map point at it, so it is
+ * aligned to keep their low bits free for the page kind.
+ */
+struct mm_heap {
+  pthread_mutex_t lock;		//held by every public call on the heap
+  char *seg_lists;		//ptr head of seg_lists table
+  char *mem_hp; 		//ptr head of heap
+  char *mem_bp;			//ptr end of heap
+#if MM_TLSF
+  unsigned int fl_bitmap;	//bit f set when sl_bitmap[f] is non zero
+  unsigned int sl_bitmap[SEG_FL_COUNT];	//bit s set when seg_lists[f * SEG_SUBCLASSES + s] is non empty
+#else
+  unsigned long long seg_bitmap;	//bit i set when seg_lists[i] is non empty
+#endif
+  size_t mmap_threshold;	//requests of this size or more are mmapped
+  size_t trim_threshold;	//free tail size that triggers a trim
+  int mmap_threshold_fixed;	//set by mm_heap_set_mmap_threshold, stops adjustment
+  struct mmap_chunk *mmaps;	//mappings of mmapped blocks
+  size_t mmapped;		//total length of those mappings
+  struct mem_region *region;	//memlib region backing the heap
+  struct mem_region own_region;	//region of a heap from mm_heap_create
+#if MM_STATS
+  struct mm_stats stats;	//counters, see mm_heap_stats
+#endif
+  void *last;			//block alloc'd or resized by the last call, see heap_check_last
+  void *last_freed;		//free block the last call made or grew
+  void *remote;			//blocks freed by threads of other arenas, see remote_free
+  int arena;			//one of arenas[], whose blocks mm_free may queue or cache
+  struct slab_run *runs[SLAB_CLASSES];	//runs with free objects, per class
+#if MM_QUICK
+  void *quick[QUICK_LISTS];	//freed blocks of each size up to QUICK_MAX, still alloc'd
+  size_t quick_bytes;		//total size of the blocks on quick lists
+#endif
+};
+
+/*
+ * tcache_bin - cached blocks of one payload size, linked through their
+ * first payload word. low_water is the least count since the last gc
+ * step of the bin, i.e. blocks the thread did not need meanwhile. fill
+ * is the number of blocks the next refill allocs: it doubles on each
+ * refill and halves when a gc step finds blocks unused, so that only
+ * sizes a thread allocs in bursts pull in batches.
+ */
+struct tcache_bin {
+  void *head;
+  unsigned int count;
+  unsigned int low_water;
+  unsigned int fill;
+};
 
-#define GET_NEXT_FREE(p) 	GET_PTR_ADDR((unsigned int*)(p))
-#define INSIDE_HEAP(p)		( (void*)p >= (void*)mem_hp && (void*)p < (void*)mem_bp )
+/*
+ * tcache - state of one thread in mm_malloc etc.: its arena and its cache
+ * of blocks. only the owning thread touches it, except for flush, which
+ * mm_trim sets to have every cache flushed at its next gc step.
+ */
+struct tcache {
+  struct tcache_bin bins[TCACHE_BINS];
+  size_t bytes;			//total size of cached blocks
+  unsigned long generation;	//value of generation the state belongs to
+  unsigned int gc_countdown;	//calls left before the next gc step
+  int gc_bin;			//bin of the next gc step
+  int flush;			//set by mm_trim
+  struct mm_heap *arena;	//arena of the thread's allocs
+  int arena_index;		//its index in arenas
+  unsigned int contention;	//contention score of the arena, see arena_lock
+  int registered;		//on the tcaches list
+  struct tcache *next;
+  struct tcache *prev;
+};
 
 //GLOBAL SCALARS
-char *seg_lists;//ptr head of seg_lists table
-char *mem_hp; 	//ptr head of heap
-char *mem_bp;	//ptr end of heap
+static struct mm_heap default_heap = {	//arena 0 of mm_malloc, mm_free etc.
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .arena = 1
+};
+static struct mm_heap *arenas[ARENAS_MAX] = { &default_heap };	//created by arena_get
+static int arena_count = 1;		//arenas threads are assigned to, see mm_init
+static int arena_next;			//next arena of round-robin assignment
+static size_t arena_mmap_threshold;	//set by mm_set_mmap_threshold, 0 if not
+static pthread_mutex_t arenas_lock = PTHREAD_MUTEX_INITIALIZER;	//arenas and tcaches
+static unsigned long generation;	//bumped by mm_init, drops stale thread states
+static struct tcache *tcaches;		//states of the threads, see tcache_get
+static __thread struct tcache tcache;	//state of the calling thread
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tcache_key;	//flushes the cache at thread exit
+static void *pagemap[PAGEMAP_SIZE( PAGEMAP_ROOT_BITS )];	//root of the page map, see pagemap_get
 
 //METHOD DEFINITIONS
+static int heap_init(struct mm_heap *h);
+static void *heap_malloc(struct mm_heap *h, size_t size);
+static void heap_free(struct mm_heap *h, void *p);
+static void *heap_realloc(struct mm_heap *h, void *p, size_t size);
 static void place(void* p, size_t size);
+static void place_free(void *p, size_t size);
+static size_t get_block_size(size_t size);
+static void split(struct mm_heap *h, void *p, size_t size);
 static int get_size_class(size_t size);
-static void *get_fit(size_t size);
-static void *grow_heap(size_t words);
-static void coalesce(void *p, size_t size);
-static void seg_list_remove(void *p);
-static void seg_list_add(void *p);
+static void *get_fit(struct mm_heap *h, size_t size);
+static void *grow_heap(struct mm_heap *h, size_t words);
+static void *heap_tail(struct mm_heap *h);
+static int trim_heap(struct mm_heap *h, size_t pad);
+static void *realloc_in_place(struct mm_heap *h, void *p, size_t size);
+#if MM_SLAB
+static void *slab_malloc(struct mm_heap *h, size_t size);
+static struct slab_run *run_create(struct mm_heap *h, int class);
+static size_t run_gap(void *p);
+static void *run_fit(struct mm_heap *h);
+static void *run_block(struct mm_heap *h);
+#endif
+static void slab_free(struct mm_heap *h, void *p);
+static int is_run(void *p);
+#if MM_TCACHE
+static size_t usable_size(size_t size);
+#endif
+static size_t block_usable(unsigned long e, void *p);
+static unsigned long pagemap_get(void *p);
+static int pagemap_set(void *start, size_t len, unsigned long e);
+static void *pagemap_node(void **slot, size_t size, int create);
+static struct mm_heap *arena_get(int i);
+static struct mm_heap *arena_lock(struct tcache *tc);
+static struct mm_heap *arena_of(void *p);
+static struct tcache *tcache_get(void);
+#if MM_TCACHE
+static void *tcache_refill(struct tcache *tc, int bin);
+static void tcache_gc(struct tcache *tc);
+#endif
+static void tcache_flush(struct tcache *tc, int bin, unsigned int n);
+#if MM_REMOTE_FREE
+static void remote_free(struct mm_heap *h, void *p);
+#endif
+static void remote_drain(struct mm_heap *h);
+static void heap_lock(struct mm_heap *h);
+static void tcache_key_init(void);
+static void tcache_exit(void *arg);
+static void stats_add(struct mm_stats *s, const struct mm_stats *a);
+static void *mmap_chunk(struct mm_heap *h, size_t size);
+static void munmap_chunk(struct mm_heap *h, void *p);
+static void munmap_chunks(struct mm_heap *h);
+static void *mremap_chunk(struct mm_heap *h, void *p, size_t size);
+static void coalesce(struct mm_heap *h, void *p, size_t size);
+#if MM_QUICK
+static void *quick_pop(struct mm_heap *h, size_t size);
+static void quick_push(struct mm_heap *h, void *p, size_t size);
+#endif
+static int consolidate(struct mm_heap *h);
+static void seg_list_remove(struct mm_heap *h, void *p);
+static void seg_list_add(struct mm_heap *h, void *p);
+static unsigned int tree_key(int class, size_t size);
+static void tree_insert(struct mm_heap *h, void *p, int class);
+static void tree_remove(struct mm_heap *h, void *p, int class);
+#if !MM_TLSF
+static void *tree_fit(struct mm_heap *h, int class, size_t size);
+#endif
+static void tree_stats(struct mm_heap *h, void *t, struct mm_stats *s);
+static size_t get_class_min(int class);
+static void class_mark(struct mm_heap *h, int class);
+static void class_unmark(struct mm_heap *h, int class);
+static int class_marked(struct mm_heap *h, int class);
+static int class_find(struct mm_heap *h, int class);
+static int fit_class(size_t size);
+static int heap_check(struct mm_heap *h);
+static int heap_check_last(struct mm_heap *h);
+static int check_block(struct mm_heap *h, void *p);
+static int check_listed(struct mm_heap *h, void *p);
+static int check_tree(struct mm_heap *h, void *t, void *parent, int class, unsigned int prefix,
+		      int depth, size_t *listed, size_t free_blocks);
+static int check_mmapped(struct mm_heap *h, void *p);
+static int check_run(struct mm_heap *h, struct slab_run *run);
+static int check_fail(const char *msg, void *p);
 
 
 /*
- * mm_init - initialize the malloc package. allocate enough space to
- * create empty seg_list table and one boundary block at head of heap.
+ * mm_init - initialize the malloc package. the default heap is (re)built
+ * over memlib's default region, see heap_init, and every other arena is
+ * released, to be created again as threads get assigned to it. blocks
+ * the default heap still has mmapped are unmapped. thread states, and
+ * the blocks their caches hold, belong to the heaps being released and
+ * are dropped as each thread next calls in, see tcache_get. the arena
+ * count is MM_ARENAS, or 4 per online cpu.
  *
- * returns: 1 if successful, -1 on failure
+ * returns: 0 if successful, -1 on failure
  */
 int mm_init( void )
 {
-  int seg_lists_size = SIZE_T_SIZE * SEG_LIST_COUNT;
-  if( ( seg_lists = mem_sbrk( ALIGN( seg_lists_size ) + MIN_BLOCK_SIZE ) ) == ( void * ) -1 )
-    return -1;
+  int i, ret;
 
-  int i;
-  for( i = 0; i < SEG_LIST_COUNT; i++ )
-    PUT( seg_lists + ( SIZE_T_SIZE * i ), 0 );
-
-  mem_hp = (char*)( seg_lists + seg_lists_size );
-  mem_hp = mem_hp + DSIZE;
-  PUT( GET_HEADER( mem_hp ), PACK( MIN_BLOCK_SIZE, 1 ) );
-  PUT( GET_FOOTER( mem_hp ), PACK( MIN_BLOCK_SIZE, 1 ) );
-  mem_bp = mem_heap_hi();
-  return 0;
+  pthread_mutex_lock( &arenas_lock );
+  for( i = 1; i < ARENAS_MAX; i++ ){
+    mm_heap_destroy( arenas[i] );
+    arenas[i] = NULL;
+  }
+  arena_count = MM_ARENAS > 0 ? MM_ARENAS : MIN( 4 * MAX( sysconf( _SC_NPROCESSORS_ONLN ), 1 ), ARENAS_MAX );
+  arena_next = 0;
+  arena_mmap_threshold = 0;
+
+  munmap_chunks( &default_heap );
+  default_heap.region = mem_default_region();
+  ret = heap_init( &default_heap );
+  __atomic_store_n( &generation, generation + 1, __ATOMIC_RELEASE );
+  pthread_mutex_unlock( &arenas_lock );
+  return ret;
 }
 
 /*
- * mm_malloc - allocate block of given size. implementation uses first first on seg_lists table.
- * when a free block is found, a basic split strategy looks to free up any used payload of alloc'd block
- * if no free block is found, the heap is extended by size.
- *
- * size_t size: size of alloc request
- *
- * returns: NULL if failure occurs, otherwise 8 byte ptr to address of allocated block's first payload byte.
+ * mm_malloc - allocate block of given size from the calling thread's
+ * arena. small requests are served from the thread's cache without
+ * locking, see tcache_refill. other requests lock the arena, see
+ * heap_malloc, and fall back to the default heap if the arena is full.
  */
 void *mm_malloc( size_t size )
 {
-  if( size == 0 )
-    return NULL;
+  struct tcache *tc = tcache_get();
+  struct mm_heap *h;
+  void *p;
+
+#if MM_TCACHE
+  if( size - 1 < TCACHE_MAX ){
+    int bin = TCACHE_BIN( usable_size( size ) );
+    struct tcache_bin *b = &tc->bins[bin];
+
+    if( --tc->gc_countdown == 0 )
+      tcache_gc( tc );
+
+    if( ( p = b->head ) == NULL )
+      return tcache_refill( tc, bin );
+
+    b->head = TCACHE_NEXT( p );
+    tc->bytes -= TCACHE_SIZE( bin );
+    if( --b->count < b->low_water )
+      b->low_water = b->count;
+    return p;
+  }
+#endif
 
-  void *fit_ptr;
-  size_t block_size;
+  h = arena_lock( tc );
+  p = heap_malloc( h, size );
+  pthread_mutex_unlock( &h->lock );
+
+  if( p == NULL && h != &default_heap && size != 0 ){
+    heap_lock( &default_heap );
+    p = heap_malloc( &default_heap, size );
+    pthread_mutex_unlock( &default_heap.lock );
+  }
+  return p;
+}
+
+/*
+ * mm_free - free block to its arena, see arena_of. a block of another
+ * arena than the calling thread's is pushed on that arena's remote queue,
+ * see remote_free. small blocks of the thread's arena go to its cache
+ * without locking, unless it is full, in which case part of the bin is
+ * flushed first (see tcache_flush). other blocks lock the arena, see
+ * heap_free. a block of a heap from mm_heap_create, which no thread
+ * drains or caches for, is freed under that heap's lock.
+ */
+void mm_free( void *p )
+{
+  unsigned long e;
+  struct mm_heap *h;
+#if MM_REMOTE_FREE || MM_TCACHE
+  size_t usable;
+#endif
+
+  if( p == NULL )
+    return;
 
-  block_size = ALIGN( size + DSIZE );
+  e = pagemap_get( p );
+  h = PAGE_OWNER( e );
+  if( !h->arena ){
+    mm_heap_free( h, p );
+    return;
+  }
+#if MM_REMOTE_FREE || MM_TCACHE
+  usable = block_usable( e, p );
+#endif
+#if MM_REMOTE_FREE
+  if( h != tcache_get()->arena && usable != 0 ){
+    remote_free( h, p );
+    return;
+  }
+#endif
 
-  if( block_size < MIN_BLOCK_SIZE )
-    block_size = ALIGN( size + MIN_BLOCK_SIZE - size );
+#if MM_TCACHE
+  if( usable - 1 < TCACHE_SIZE( TCACHE_BINS - 1 ) ){
+    struct tcache *tc = tcache_get();
+    int bin = TCACHE_BIN( usable );
+    struct tcache_bin *b = &tc->bins[bin];
 
-  if( ( fit_ptr = get_fit( block_size ) ) != NULL ){
-    size_t split_remainder = GET_SIZE( GET_HEADER( fit_ptr ) ) - block_size;
+    if( --tc->gc_countdown == 0 )
+      tcache_gc( tc );
 
-    if( ( GET_SIZE( GET_HEADER( fit_ptr ) ) - block_size ) >= MIN_BLOCK_SIZE ){
-      seg_list_remove( fit_ptr );
-      place( fit_ptr, block_size );
-      void* new_ptr = ( GET_SIZE( GET_HEADER( fit_ptr ) ) + fit_ptr );
-      PUT( GET_HEADER( new_ptr ), PACK( split_remainder, 0 ) );
-      PUT( GET_FOOTER( new_ptr ), PACK( split_remainder, 0 ) );
-      seg_list_add( new_ptr );
+    if( b->count >= TCACHE_COUNT || tc->bytes + usable > TCACHE_BYTES )
+      tcache_flush( tc, bin, TCACHE_BATCH );
 
-    }else{
-      place( fit_ptr, GET_SIZE( GET_HEADER( fit_ptr ) ) );
-      seg_list_remove( fit_ptr );
+    if( b->count < TCACHE_COUNT && tc->bytes + usable <= TCACHE_BYTES ){
+      TCACHE_NEXT( p ) = b->head;
+      b->head = p;
+      b->count++;
+      tc->bytes += usable;
+      return;
     }
+  }
+#endif
+
+  heap_lock( h );
+  heap_free( h, p );
+  pthread_mutex_unlock( &h->lock );
+}
 
-  } else if( ( fit_ptr = grow_heap( block_size ) ) != NULL ){
-      place( fit_ptr, block_size );
+/*
+ * mm_realloc - resize block in its arena, see heap_realloc. a null ptr
+ * allocs and a zero size frees, as with mm_malloc and mm_free.
+ */
+void *mm_realloc( void *ptr, size_t size )
+{
+  struct mm_heap *h;
+  void *p;
 
-  } else {
+  if( ptr == NULL )
+    return mm_malloc( size );
+  if( size == 0 ){
+    mm_free( ptr );
     return NULL;
   }
-  return fit_ptr;
+
+  h = arena_of( ptr );
+  heap_lock( h );
+  p = heap_realloc( h, ptr, size );
+  pthread_mutex_unlock( &h->lock );
+  return p;
 }
 
 /*
- * mm_free - free block from ptr of first payload byte. implementation relies on coalesce. see
- * coalesce for more details.
+ * mm_usable_size - bytes of the block of ptr that the caller may use, at
+ * least the size it was alloc'd or last resized with. found from the page
+ * map without locking the block's arena.
  *
- *  * void* ptr: ptr to first byte of block's payload. ptr must not have already been freed
+ * void* ptr: ptr to first byte of block's payload, or null
  *
+ * returns: size_t usable bytes, 0 for a null ptr
  */
-void mm_free( void *p )
+size_t mm_usable_size( void *ptr )
 {
-  if ( p == NULL )
-    return;
+  unsigned long e;
 
-  size_t size = GET_SIZE( GET_HEADER( p ) );
-  coalesce( p, size );
+  if( ptr == NULL )
+    return 0;
+
+  e = pagemap_get( ptr );
+  if( PAGE_KIND( e ) == PAGE_MMAP )
+    return MMAP_CHUNK( ptr )->len - MMAP_HEADER_SIZE;
+  return block_usable( e, ptr );
 }
 
 /*
- * mm_realloc - mm_realloc resizes block of ptr. if ptr is null, a new block is alloc'd.
- * if size is 0, the block of ptr is freed. otherwise block of ptr is resized to size.
- * returned ptr could be different then original in which case contents of original block
- * (up to size of new block) are copied. implementation is based on mm_alloc and mm_free.
- * see mm_alloc and mm_free for more detail.s
- *
- * void* ptr: ptr to first byte of block's payload.
- * size_t* size: desired block size.
- *
- * returns: 8 byte ptr to address of newly resized block
+ * mm_trim - trim every arena, after freeing the blocks on its remote
+ * queue and consolidating its quick lists. see mm_heap_trim. every
+ * thread is also asked to flush its cache at its next gc step, so that
+ * the blocks they hold can be trimmed by a later call.
  *
+ * returns: 1 if memory was released, 0 otherwise
  */
-void *mm_realloc( void *ptr, size_t size )
+int mm_trim( size_t pad )
 {
-  if ( ptr == NULL )
-    return mm_malloc( size );
-  if( size == 0 ){
-    mm_free( ptr );
-    return NULL;
-  }
+  struct tcache *tc;
+  struct mm_heap *h;
+  int i, ret = 0;
+
+  pthread_mutex_lock( &arenas_lock );
+  for( tc = tcaches; tc != NULL; tc = tc->next )
+    __atomic_store_n( &tc->flush, 1, __ATOMIC_RELAXED );
+  pthread_mutex_unlock( &arenas_lock );
+
+  for( i = 0; i < ARENAS_MAX; i++ )
+    if( ( h = __atomic_load_n( &arenas[i], __ATOMIC_ACQUIRE ) ) != NULL ){
+      heap_lock( h );
+      consolidate( h );
+      ret |= trim_heap( h, pad );
+      pthread_mutex_unlock( &h->lock );
+    }
+  return ret;
+}
 
-  void *old_ptr = ptr;
-  void *new_ptr;
-  size_t copySize;
+/*
+ * mm_set_mmap_threshold - set mmap threshold of every arena, including
+ * those created later. see mm_heap_set_mmap_threshold.
+ */
+void mm_set_mmap_threshold( size_t threshold )
+{
+  int i;
 
-  new_ptr = mm_malloc( size );
-  if ( new_ptr == NULL )
-    return NULL;
-  copySize = GET_SIZE( GET_HEADER(ptr ) ) - DSIZE;
+  pthread_mutex_lock( &arenas_lock );
+  arena_mmap_threshold = threshold;
+  for( i = 0; i < ARENAS_MAX; i++ )
+    if( arenas[i] != NULL )
+      mm_heap_set_mmap_threshold( arenas[i], threshold );
+  pthread_mutex_unlock( &arenas_lock );
+}
 
-  if ( size < copySize )
-    copySize = size;
+/*
+ * mm_stats - statistics summed over the arenas. see mm_heap_stats.
+ * peak_bytes is the sum of the arenas' peaks, an upper bound of the
+ * peak of their sum.
+ */
+void mm_stats( struct mm_stats *s )
+{
+  struct mm_stats a;
+  struct mm_heap *h;
+  int i;
 
-  memcpy( new_ptr, old_ptr, copySize );
+  mm_heap_stats( &default_heap, s );
+  for( i = 1; i < ARENAS_MAX; i++ )
+    if( ( h = __atomic_load_n( &arenas[i], __ATOMIC_ACQUIRE ) ) != NULL ){
+      mm_heap_stats( h, &a );
+      stats_add( s, &a );
+    }
+}
 
-  mm_free( old_ptr );
+/*
+ * mm_mmapped - mapped bytes of every arena. see mm_heap_mmapped.
+ */
+size_t mm_mmapped( void )
+{
+  struct mm_heap *h;
+  size_t mapped = 0;
+  int i;
 
-  mem_bp = mem_heap_hi();
-  return new_ptr;
+  for( i = 0; i < ARENAS_MAX; i++ )
+    if( ( h = __atomic_load_n( &arenas[i], __ATOMIC_ACQUIRE ) ) != NULL )
+      mapped += mm_heap_mmapped( h );
+  return mapped;
 }
 
 /*
- * place - update block's header and footer data with alloc bit and size
- *
- * void* ptr: ptr to first byte of block's payload.
- * size_t* size: desired block size.
- *
+ * mm_check - check every arena. see mm_heap_check.
  */
-static void place( void* p, size_t size ){
-  if ( p == NULL || size == 0 )
-    return;
+int mm_check( void )
+{
+  struct mm_heap *h;
+  int i;
 
-  PUT( GET_HEADER( p ), PACK( size, 1 ) );
-  PUT( GET_FOOTER( p ), PACK( size, 1 ) );
+  for( i = 0; i < ARENAS_MAX; i++ )
+    if( ( h = __atomic_load_n( &arenas[i], __ATOMIC_ACQUIRE ) ) != NULL && mm_heap_check( h ) < 0 )
+      return -1;
+  return 0;
 }
 
 /*
- * get_size_class - calculate size class lookup of seg_lists table
- * with naive hash strategy
- *
- * size_t* size: desired block size.
- *
- * returns: int, where 0 <= size class < SEG_LIST_COUNT
+ * mm_check_last - check what the last call changed in every arena. see
+ * mm_heap_check_last.
  */
-static int get_size_class( size_t size )
+int mm_check_last( void )
 {
-  int class = size/64;
-  if( class >= SEG_LIST_COUNT )
-    return SEG_LIST_COUNT -1;
-  else if ( class < 0 )
-    return 0;
-  else
-    return class;
+  struct mm_heap *h;
+  int i;
+
+  for( i = 0; i < ARENAS_MAX; i++ )
+    if( ( h = __atomic_load_n( &arenas[i], __ATOMIC_ACQUIRE ) ) != NULL && mm_heap_check_last( h ) < 0 )
+      return -1;
+  return 0;
 }
 
 /*
- * get_fit - find free block of size from seg_lists table.
- * implementation based on first fit strategy, starting from
- * seg_list fit size class.
+ * mm_heap_create - create a heap independent of the default heap and of
+ * any other heap. the heap reserves max_heap bytes of address space in a
+ * memlib region of its own and keeps its state in the region's first bytes.
  *
- * size_t* size: desired block size.
+ * size_t max_heap: largest size the heap can grow to, mmapped blocks aside.
  *
- * returns:  8 byte ptr to first payload byte address of fit block.
+ * returns: NULL if failure occurs, otherwise the new heap
  */
-
-static void* get_fit( size_t size )
+mm_heap_t *mm_heap_create( size_t max_heap )
 {
-  int i = get_size_class( size );
+  struct mem_region region;
+  struct mm_heap *h;
 
-  while( i < SEG_LIST_COUNT ){
-    void* j;
-
-    for ( j = GET_PTR_ADDR( seg_lists + ( sizeof( size_t*)*i ) ); INSIDE_HEAP( j ) && j != 0; ) {
+  if( mem_region_init( &region, max_heap ) < 0 )
+    return NULL;
 
-      if( !GET_ALLOC( GET_HEADER( j ) ) && GET_SIZE( GET_HEADER( j ) ) >= size )
-        return j;
+  if( ( h = mem_region_sbrk( &region, ALIGN( sizeof( struct mm_heap ) ) ) ) == ( void * ) -1 ){
+    mem_region_deinit( &region );
+    return NULL;
+  }
 
-      j = GET_NEXT_FREE( j );
-    }
+  h->own_region = region;
+  h->region = &h->own_region;
+  h->arena = 0;
+  pthread_mutex_init( &h->lock, NULL );
 
-    i++;
+  if( heap_init( h ) < 0 ){
+    pthread_mutex_destroy( &h->lock );
+    pagemap_set( mem_region_heap_lo( &region ), mem_region_heapsize( &region ), 0 );
+    mem_region_deinit( &region );
+    return NULL;
   }
-
-  return NULL;
+  return h;
 }
 
 /*
- * grow_heap - extend heap by size and mark
- * new block as free.
+ * mm_heap_destroy - release a heap from mm_heap_create along with every
+ * block still alloc'd from it, mmapped blocks included, and clear its
+ * pages from the page map. no other thread may be using the heap.
  *
- * size_t* size: desired block size.
+ * mm_heap_t* h: heap to destroy.
  *
- * returns: NULL if failure occurs, otherwise 8 byte ptr to address of allocated block's first payload byte.
  */
-static void *grow_heap( size_t size )
+void mm_heap_destroy( mm_heap_t *h )
 {
-  if( size == 0 )
-    return NULL;
+  if( h == NULL )
+    return;
 
-  void* ptr =  mem_sbrk( size );
+  munmap_chunks( h );
 
-  if( (long)ptr == -1 )
-    return NULL;
+  pthread_mutex_destroy( &h->lock );
+  struct mem_region region = h->own_region;
+  pagemap_set( mem_region_heap_lo( &region ), mem_region_heapsize( &region ), 0 );
+  mem_region_deinit( &region );
+}
+
+/*
+ * mm_heap_malloc - allocate block of given size from heap h under its
+ * lock. see heap_malloc.
+ */
+void *mm_heap_malloc( mm_heap_t *h, size_t size )
+{
+  void *p;
 
-  ptr = ptr + DSIZE;
+  heap_lock( h );
+  p = heap_malloc( h, size );
+  pthread_mutex_unlock( &h->lock );
+  return p;
+}
 
-  PUT( GET_HEADER( ptr ), PACK( size, 0 ) );
-  PUT( GET_FOOTER( ptr ), PACK( size, 0 ) );
+/*
+ * mm_heap_free - free block of heap h under its lock. see heap_free.
+ */
+void mm_heap_free( mm_heap_t *h, void *p )
+{
+  heap_lock( h );
+  heap_free( h, p );
+  pthread_mutex_unlock( &h->lock );
+}
 
-  mem_bp = mem_heap_hi();
-  return ptr;
+/*
+ * mm_heap_realloc - resize block of heap h under its lock. see heap_realloc.
+ */
+void *mm_heap_realloc( mm_heap_t *h, void *ptr, size_t size )
+{
+  void *p;
 
+  heap_lock( h );
+  p = heap_realloc( h, ptr, size );
+  pthread_mutex_unlock( &h->lock );
+  return p;
 }
 
 /*
- * coalesce - free block of ptr and of size. combine with neighboring blocks
- * if free.
+ * mm_heap_trim - return free memory at the end of heap h to the memory system,
+ * keeping at least pad free bytes at the end of heap for future requests.
+ * memory is released in whole pages, after the quick lists are consolidated.
+ * free and realloc already trim on their own once the free tail block
+ * reaches trim_threshold.
  *
- * void* ptr: ptr to first byte of block's payload.
- * size_t* size: desired block size.
+ * mm_heap_t* h: heap to trim.
+ * size_t pad: free bytes to keep at the end of heap.
  *
+ * returns: 1 if memory was released, 0 otherwise
  */
-
-static void coalesce( void *p, size_t size )
+int mm_heap_trim( mm_heap_t *h, size_t pad )
 {
-  if ( p == NULL || size == 0 )
-    return;
+  int ret;
 
-  int prev_elig = ( INSIDE_HEAP( GET_PREV( p ) ) && !GET_ALLOC( GET_HEADER( GET_PREV( p ) ) ) );
-  int next_elig = ( INSIDE_HEAP( GET_NEXT( p ) ) && !GET_ALLOC( GET_HEADER( GET_NEXT( p ) ) ) );
-  void* start_p = p;
-  size_t free_size = size;
+  heap_lock( h );
+  consolidate( h );
+  ret = trim_heap( h, pad );
+  pthread_mutex_unlock( &h->lock );
+  return ret;
+}
 
-  if( prev_elig ){
-    free_size += GET_SIZE( GET_HEADER( GET_PREV( p ) ) );
-    seg_list_remove( GET_PREV( p ) );
-    start_p = GET_PREV( p );
-  }
+/*
+ * mm_heap_set_mmap_threshold - set the request size from which blocks of
+ * heap h are mmapped instead of alloc'd from the heap. a set threshold no
+ * longer follows the size of freed mappings.
+ *
+ * mm_heap_t* h: heap to configure.
+ * size_t threshold: smallest request size to mmap.
+ *
+ */
+void mm_heap_set_mmap_threshold( mm_heap_t *h, size_t threshold )
+{
+  pthread_mutex_lock( &h->lock );
+  h->mmap_threshold = threshold;
+  h->mmap_threshold_fixed = 1;
+  pthread_mutex_unlock( &h->lock );
+}
 
-  if( next_elig ){
-    free_size += GET_SIZE( GET_HEADER( GET_NEXT( p ) ) );
-    seg_list_remove( GET_NEXT( p ) );
+/*
+ * mm_heap_stats - fill s with the statistics of heap h since it was
+ * initialized. the counters are kept as the heap works and are all 0 in a
+ * build with MM_STATS set to 0, which leaves s->counted clear. heap and
+ * mmapped sizes and the free blocks per class are always filled in, the
+ * latter by walking the seg_lists table.
+ *
+ * mm_heap_t* h: heap to query.
+ * struct mm_stats* s: statistics to fill.
+ *
+ */
+void mm_heap_stats( mm_heap_t *h, struct mm_stats *s )
+{
+  pthread_mutex_lock( &h->lock );
+#if MM_STATS
+  *s = h->stats;
+  s->counted = 1;
+#else
+  memset( s, 0, sizeof( *s ) );
+#endif
+  s->heap_bytes = mem_region_heapsize( h->region );
+  s->mmapped_bytes = h->mmapped;
+  s->classes = SEG_LIST_COUNT;
 
+  int i;
+  for( i = 0; i < SEG_LIST_COUNT; i++ ){
+    void *j;
+    s->class_min[i] = get_class_min( i );
+    if( i >= SEG_TREE_CLASS ){
+      tree_stats( h, GET_LINK( h, SEG_LIST_HEAD( h, i ) ), s );
+      continue;
+    }
+    for( j = GET_LINK( h, SEG_LIST_HEAD( h, i ) ); j != NULL; j = GET_NEXT_FREE( h, j ) ){
+      s->free_blocks[i]++;
+      s->free_bytes[i] += GET_SIZE( GET_HEADER( j ) );
+    }
   }
+  pthread_mutex_unlock( &h->lock );
+}
+
+/*
+ * mm_heap_check - check the whole of heap h for consistency: every block
+ * from mem_hp to mem_bp, every seg_lists list and every mmapped block.
+ * the first problem found is reported on stderr. see heap_check. blocks
+ * held by thread caches count as alloc'd.
+ *
+ * mm_heap_t* h: heap to check.
+ *
+ * returns: 0 if the heap is consistent, -1 otherwise
+ */
+int mm_heap_check( mm_heap_t *h )
+{
+  int ret;
 
-  PUT( GET_HEADER( start_p ), PACK( free_size, 0 ) );
-  PUT( GET_FOOTER( start_p ), PACK( free_size, 0 ) );
-  seg_list_add( start_p );
+  pthread_mutex_lock( &h->lock );
+  ret = heap_check( h );
+  pthread_mutex_unlock( &h->lock );
+  return ret;
 }
 
 /*
- * seg_list_remove - remove free block from seg_lists table.
+ * mm_heap_check_last - check the blocks of heap h that the last
+ * malloc, free or realloc on it changed, and their neighbours. cheap
+ * enough to run after every call. see heap_check_last.
  *
- * void* ptr: ptr to first byte of block's payload.
+ * mm_heap_t* h: heap to check.
  *
+ * returns: 0 if the blocks are consistent, -1 otherwise
  */
-static void seg_list_remove( void *p )
+int mm_heap_check_last( mm_heap_t *h )
 {
+  int ret;
 
-  int class_size = get_size_class( GET_SIZE( GET_HEADER( p ) ) );
-  void* j;
-  void* k = seg_lists + ( sizeof(void*) * class_size );
+  pthread_mutex_lock( &h->lock );
+  ret = heap_check_last( h );
+  pthread_mutex_unlock( &h->lock );
+  return ret;
+}
 
+/*
+ * mm_heap_mmapped - total length of the mappings that hold mmapped blocks
+ * of heap h. these bytes are not part of the heap's region, so a heap's
+ * footprint is its region's heap size plus this.
+ *
+ * mm_heap_t* h: heap to query.
+ *
+ * returns: size_t bytes mapped
+ */
+size_t mm_heap_mmapped( mm_heap_t *h )
+{
+  return h->mmapped;
+}
 
-  for ( j = GET_PTR_ADDR( seg_lists + ( sizeof(size_t*) * class_size ) ); INSIDE_HEAP( j ) && j != 0; ) {
+/*
+ * heap_init - initialize heap h over its region. allocate enough space to
+ * create empty seg_list table, one boundary block at head of heap and
+ * the zero sized epilogue header that marks the end of heap, and enter
+ * the region's pages so far in the page map.
+ *
+ * returns: 0 if successful, -1 on failure
+ */
+static int heap_init( struct mm_heap *h )
+{
+  int seg_lists_size = ALIGN( WSIZE * SEG_LIST_COUNT );
+  if( ( h->seg_lists = mem_region_sbrk( h->region, seg_lists_size + MIN_BLOCK_SIZE + DSIZE ) ) == ( void * ) -1 )
+    return -1;
+  if( pagemap_set( mem_region_heap_lo( h->region ), mem_region_heapsize( h->region ), PAGE_ENTRY( h, PAGE_BLOCKS ) ) < 0 )
+    return -1;
 
-    if( p == j ){
-      if( INSIDE_HEAP( GET_NEXT_FREE( j ) ) && GET_NEXT_FREE( j ) != 0 )
-        PUT_PTR_ADDR( k, GET_NEXT_FREE( j ) );
-      else
-        PUT_PTR_ADDR( k, 0 );
+  int i;
+  for( i = 0; i < SEG_LIST_COUNT; i++ )
+    PUT( SEG_LIST_HEAD( h, i ), 0 );
+#if MM_TLSF
+  h->fl_bitmap = 0;
+  memset( h->sl_bitmap, 0, sizeof( h->sl_bitmap ) );
+#else
+  h->seg_bitmap = 0;
+#endif
+#if MM_STATS
+  memset( &h->stats, 0, sizeof( h->stats ) );
+#endif
+  STAT( h, sbrk_calls, 1 );
+  STAT( h, sbrk_bytes, seg_lists_size + MIN_BLOCK_SIZE + DSIZE );
+  h->mmap_threshold = MMAP_THRESHOLD;
+  h->trim_threshold = TRIM_THRESHOLD;
+  h->mmap_threshold_fixed = 0;
+  h->mmaps = NULL;
+  h->mmapped = 0;
+  h->last = NULL;
+  h->last_freed = NULL;
+  h->remote = NULL;
+  memset( h->runs, 0, sizeof( h->runs ) );
+#if MM_QUICK
+  memset( h->quick, 0, sizeof( h->quick ) );
+  h->quick_bytes = 0;
+#endif
+
+  h->mem_hp = (char*)( h->seg_lists + seg_lists_size );
+  h->mem_hp = h->mem_hp + DSIZE;
+  PUT( GET_HEADER( h->mem_hp ), PACK( MIN_BLOCK_SIZE, PREV_ALLOC | 1 ) );
+  PUT( GET_HEADER( GET_NEXT( h->mem_hp ) ), PACK( 0, PREV_ALLOC | 1 ) );
+  h->mem_bp = mem_region_heap_hi( h->region );
+  return 0;
+}
 
-      PUT_PTR_ADDR( p, 0 );
-      return;
-    }
+/*
+ * heap_malloc - allocate block of given size. implementation uses first first on seg_lists table.
+ * when a free block is found, a basic split strategy looks to free up any used payload of alloc'd block
+ * if no free block is found, the heap is extended (see grow_heap) and the new block is split the same way.
+ * requests of mmap_threshold bytes or more are mmapped instead, falling back to the heap if that fails.
+ * requests of up to SLAB_MAX bytes are served from slab runs, see slab_malloc. a block of the
+ * exact size on the quick lists is taken first, and they are consolidated before the heap grows.
+ *
+ * size_t size: size of alloc request
+ *
+ * returns: NULL if failure occurs, otherwise 8 byte ptr to address of allocated block's first payload byte.
+ */
+static inline void *heap_malloc( struct mm_heap *h, size_t size )
+{
+  if( size == 0 )
+    return NULL;
+
+  void *fit_ptr;
 
-    k = j;
-    j = GET_NEXT_FREE( j );
+#if MM_SLAB
+  if( size <= SLAB_MAX && ( fit_ptr = slab_malloc( h, size ) ) != NULL )
+    return fit_ptr;
+#endif
+
+#if MM_QUICK
+  if( size <= QUICK_MAX - WSIZE && ( fit_ptr = quick_pop( h, get_block_size( size ) ) ) != NULL ){
+    STAT( h, mallocs, 1 );
+    STAT_LIVE( h, PAYLOAD_SIZE( fit_ptr ) );
+    h->last = fit_ptr;
+    h->last_freed = NULL;
+    return fit_ptr;
+  }
+#endif
+
+  if( size >= h->mmap_threshold && ( fit_ptr = mmap_chunk( h, size ) ) != NULL ){
+    STAT( h, mallocs, 1 );
+    STAT_LIVE( h, PAYLOAD_SIZE( fit_ptr ) );
+    h->last = fit_ptr;
+    h->last_freed = NULL;
+    return fit_ptr;
   }
+
+  if( size > MAX_BLOCK_SIZE - WSIZE )
+    return NULL;
+
+  size_t block_size = get_block_size( size );
+
+  if( ( fit_ptr = get_fit( h, block_size ) ) == NULL && consolidate( h ) )
+    fit_ptr = get_fit( h, block_size );
+  if( fit_ptr != NULL )
+    seg_list_remove( h, fit_ptr );
+  else if( ( fit_ptr = grow_heap( h, block_size ) ) == NULL )
+    return NULL;
+
+  split( h, fit_ptr, block_size );
+  STAT( h, mallocs, 1 );
+  STAT_LIVE( h, PAYLOAD_SIZE( fit_ptr ) );
+  h->last = fit_ptr;
+  h->last_freed = NULL;
+  return fit_ptr;
 }
 
 /*
- * seg_list_add - add free block to seg_lists table. block will be pushed
- * on top of stack for given size class
+ * heap_free - free block from ptr of first payload byte. implementation relies on coalesce. see
+ * coalesce for more details. blocks of up to QUICK_MAX bytes go on the quick lists instead,
+ * see quick_push.
  *
- *  * void* ptr: ptr to first byte of block's payload.
+ *  * void* ptr: ptr to first byte of block's payload. ptr must not have already been freed
  *
  */
-
-static void seg_list_add( void *p )
+static inline void heap_free( struct mm_heap *h, void *p )
 {
   if ( p == NULL )
     return;
-  int class_size = get_size_class( GET_SIZE( GET_HEADER( p ) ) );
 
-  if( !!GET_PTR_ADDR( seg_lists + ( class_size * SIZE_T_SIZE ) ) 
-    && GET_PTR_ADDR( seg_lists + ( class_size * SIZE_T_SIZE ) ) != p )
-    
-    PUT_PTR_ADDR(p,GET_PTR_ADDR(seg_lists +(class_size * SIZE_T_SIZE ) ));
-
-  else
-    PUT_PTR_ADDR( p, 0 );
+  if( is_run( p ) ){
+    slab_free( h, p );
+    return;
+  }
 
+  STAT( h, frees, 1 );
+  STAT_LIVE( h, -PAYLOAD_SIZE( p ) );
+  h->last = NULL;
+  h->last_freed = NULL;
 
-  PUT_PTR_ADDR( seg_lists + ( class_size * SIZE_T_SIZE ), p );
+  if( GET_MMAPPED( GET_HEADER( p ) ) ){
+    munmap_chunk( h, p );
+    return;
+  }
 
+  size_t size = GET_SIZE( GET_HEADER( p ) );
+#if MM_QUICK
+  if( size <= QUICK_MAX ){
+    quick_push( h, p, size );
+    return;
+  }
+#endif
+  coalesce( h, p, size );
 }
 
+/*
+ * heap_realloc - resizes block of ptr. if ptr is null, a new block is alloc'd.
+ * if size is 0, the block of ptr is freed. otherwise block of ptr is resized to size.
+ * the block is resized in place when possible, trying in order: the block already fits,
+ * the block shrinks and its tail is freed, the block absorbs a free next neighbour, the
+ * block (or its free next neighbour) is last in heap and the heap is extended under it (see
+ * realloc_in_place), again after consolidating the quick lists. mmapped blocks are resized
+ * with mremap. only when all of these fail is a new block alloc'd, in which case contents of
+ * original block (up to size of new block) are copied and the original block is coalesced
+ * without going through the quick lists, as its size is unlikely to be asked for again.
+ * each call bumps the stats counter of the path it took. an object of a slab run stays in
+ * place as long as size fits its class, and moves otherwise.
+ *
+ * void* ptr: ptr to first byte of block's payload.
+ * size_t* size: desired block size.
+ *
+ * returns: 8 byte ptr to address of newly resized block
+ *
+ */
+static inline void *heap_realloc( struct mm_heap *h, void *ptr, size_t size )
+{
+  if ( ptr == NULL )
+    return heap_malloc( h, size );
+  if( size == 0 ){
+    heap_free( h, ptr );
+    return NULL;
+  }
+
+  void *new_ptr;
+  size_t old_size;
+
+  STAT( h, reallocs, 1 );
+  h->last_freed = NULL;
+
+  if( is_run( ptr ) ){
+    old_size = RUN_OF( ptr )->size;
+    if( size <= old_size ){
+      STAT( h, realloc_paths[MM_REALLOC_FITS], 1 );
+      h->last = RUN_OF( ptr );
+      return ptr;
+    }
+    if( ( new_ptr = heap_malloc( h, size ) ) == NULL )
+      return NULL;
+
+    memcpy( new_ptr, ptr, old_size );
+    slab_free( h, ptr );
+    STAT( h, realloc_paths[MM_REALLOC_MOVE], 1 );
+    h->last = is_run( new_ptr ) ? RUN_OF( new_ptr ) : new_ptr;
+    return new_ptr;
+  }
+
+  old_size = PAYLOAD_SIZE( ptr );
+  if( GET_MMAPPED( GET_HEADER( ptr ) ) ){
+    if( ( new_ptr = mremap_chunk( h, ptr, size ) ) != NULL ){
+      STAT_LIVE( h, PAYLOAD_SIZE( new_ptr ) - old_size );
+      h->last = new_ptr;
+      return new_ptr;
+    }
+  }else if( size <= MAX_BLOCK_SIZE - WSIZE && ( realloc_in_place( h, ptr, size ) != NULL
+	    || ( consolidate( h ) && realloc_in_place( h, ptr, size ) != NULL ) ) ){
+    STAT_LIVE( h, PAYLOAD_SIZE( ptr ) - old_size );
+    h->last = ptr;
+    return ptr;
+  }
+
+  if ( ( new_ptr = heap_malloc( h, size ) ) == NULL )
+    return NULL;
+
+  memcpy( new_ptr, ptr, MIN( size, old_size ) );
+  if( GET_MMAPPED( GET_HEADER( ptr ) ) )
+    heap_free( h, ptr );
+  else{
+    STAT( h, frees, 1 );
+    STAT_LIVE( h, -old_size );
+    coalesce( h, ptr, GET_SIZE( GET_HEADER( ptr ) ) );
+  }
+  STAT( h, realloc_paths[MM_REALLOC_MOVE], 1 );
+  h->last = is_run( new_ptr ) ? RUN_OF( new_ptr ) : new_ptr;
+  return new_ptr;
+}
+
+/*
+ * arena_get - arena i, created over a region of ARENA_SIZE bytes if it
+ * does not exist yet. falls back to the default heap if the arena cannot
+ * be created.
+ *
+ * int i: arena index, below arena_count
+ *
+ * returns: ptr to the arena
+ */
+static struct mm_heap *arena_get( int i )
+{
+  struct mm_heap *h;
+
+  if( ( h = __atomic_load_n( &arenas[i], __ATOMIC_ACQUIRE ) ) != NULL )
+    return h;
+
+  pthread_mutex_lock( &arenas_lock );
+  if( ( h = arenas[i] ) == NULL && ( h = mm_heap_create( ARENA_SIZE ) ) != NULL ){
+    h->arena = 1;
+    if( arena_mmap_threshold > 0 ){
+      h->mmap_threshold = arena_mmap_threshold;
+      h->mmap_threshold_fixed = 1;
+    }
+    __atomic_store_n( &arenas[i], h, __ATOMIC_RELEASE );
+  }
+  pthread_mutex_unlock( &arenas_lock );
+  return h != NULL ? h : &default_heap;
+}
+
+/*
+ * arena_lock - lock the arena of tc and free the blocks on its remote
+ * queue. a lock found taken raises the contention score of the thread
+ * by 2 and one found free lowers it by 1, so the score climbs while more
+ * than a third of the thread's attempts have to wait. once it reaches
+ * ARENA_CONTENTION the thread moves on to the next arena, which spreads
+ * threads that collide over the arenas.
+ *
+ * returns: ptr to the locked arena
+ */
+static struct mm_heap *arena_lock( struct tcache *tc )
+{
+  struct mm_heap *h = tc->arena;
+
+  if( pthread_mutex_trylock( &h->lock ) == 0 ){
+    if( tc->contention > 0 )
+      tc->contention--;
+    remote_drain( h );
+    return h;
+  }
+
+  tc->contention += 2;
+  if( tc->contention >= ARENA_CONTENTION && arena_count > 1 ){
+    tc->contention = 0;
+    tc->arena_index = ( tc->arena_index + 1 ) % arena_count;
+    h = tc->arena = arena_get( tc->arena_index );
+  }
+  heap_lock( h );
+  return h;
+}
+
+/*
+ * arena_of - arena block p was alloc'd from, the owner of its page in the
+ * page map.
+ *
+ * void* p: ptr to first byte of block's payload
+ *
+ * returns: ptr to the arena
+ */
+static inline struct mm_heap *arena_of( void *p )
+{
+  return PAGE_OWNER( pagemap_get( p ) );
+}
+
+/*
+ * tcache_get - state of the calling thread. a thread that has not called
+ * in since the last mm_init registers its state, drops whatever its cache
+ * holds (those blocks belonged to heaps since rebuilt) and is assigned an
+ * arena: round-robin, or by the cpu it runs on with ARENA_BY_CPU.
+ *
+ * returns: ptr to the thread's state
+ */
+static inline struct tcache *tcache_get( void )
+{
+  struct tcache *tc = &tcache;
+  int i;
+
+  if( tc->generation == __atomic_load_n( &generation, __ATOMIC_ACQUIRE ) )
+    return tc;
+
+  pthread_once( &tcache_once, tcache_key_init );
+  pthread_mutex_lock( &arenas_lock );
+  memset( tc->bins, 0, sizeof( tc->bins ) );
+  for( i = 0; i < TCACHE_BINS; i++ )
+    tc->bins[i].fill = 1;
+  tc->bytes = 0;
+  tc->generation = generation;
+  tc->gc_countdown = TCACHE_GC_OPS;
+  tc->gc_bin = 0;
+  tc->flush = 0;
+  tc->contention = 0;
+#if ARENA_BY_CPU
+  tc->arena_index = MAX( sched_getcpu(), 0 ) % arena_count;
+#else
+  tc->arena_index = arena_next++ % arena_count;
+#endif
+  if( !tc->registered ){
+    tc->prev = NULL;
+    tc->next = tcaches;
+    if( tc->next != NULL )
+      tc->next->prev = tc;
+    tcaches = tc;
+    tc->registered = 1;
+  }
+  pthread_mutex_unlock( &arenas_lock );
+  tc->arena = arena_get( tc->arena_index );
+  pthread_setspecific( tcache_key, tc );
+  return tc;
+}
+
+#if MM_TCACHE
+/*
+ * tcache_refill - alloc a block for empty bin of tc, and fill - 1 more
+ * blocks of the same size into the bin, all under one lock of the
+ * thread's arena. the bin stays within TCACHE_COUNT and the cache within
+ * TCACHE_BYTES.
+ *
+ * int bin: bin index of tc
+ *
+ * returns: NULL if failure occurs, otherwise ptr to the first block
+ */
+static void *tcache_refill( struct tcache *tc, int bin )
+{
+  struct tcache_bin *b = &tc->bins[bin];
+  size_t size = TCACHE_SIZE( bin );
+  struct mm_heap *h = arena_lock( tc );
+  void *first, *p;
+  int i;
+
+  first = heap_malloc( h, size );
+  if( first != NULL && block_usable( pagemap_get( first ), first ) != 0 ){
+    for( i = 1; i < b->fill && b->count < TCACHE_COUNT; i++ ){
+      if( tc->bytes + size > TCACHE_BYTES )
+        break;
+      if( ( p = heap_malloc( h, size ) ) == NULL )
+        break;
+      if( block_usable( pagemap_get( p ), p ) == 0 ){
+        heap_free( h, p );
+        break;
+      }
+      TCACHE_NEXT( p ) = b->head;
+      b->head = p;
+      b->count++;
+      tc->bytes += size;
+    }
+  }
+  pthread_mutex_unlock( &h->lock );
+  b->fill = MIN( 2 * b->fill, TCACHE_BATCH );
+
+  if( first == NULL && h != &default_heap ){
+    heap_lock( &default_heap );
+    first = heap_malloc( &default_heap, size );
+    pthread_mutex_unlock( &default_heap.lock );
+  }
+  return first;
+}
+#endif
+
+/*
+ * tcache_flush - free up to n blocks of a bin of tc back to their arenas.
+ * blocks of one arena in a row are freed under one lock. blocks of other
+ * arenas than the thread's, left from before it moved, go to their
+ * remote queues.
+ *
+ * int bin: bin index of tc
+ * unsigned int n: blocks to free
+ */
+static void tcache_flush( struct tcache *tc, int bin, unsigned int n )
+{
+  struct tcache_bin *b = &tc->bins[bin];
+  struct mm_heap *h = NULL, *owner;
+  void *p;
+
+  while( n-- > 0 && ( p = b->head ) != NULL ){
+    b->head = TCACHE_NEXT( p );
+    b->count--;
+    tc->bytes -= TCACHE_SIZE( bin );
+    owner = arena_of( p );
+#if MM_REMOTE_FREE
+    if( owner != tc->arena ){
+      remote_free( owner, p );
+      continue;
+    }
+#endif
+    if( owner != h ){
+      if( h != NULL )
+        pthread_mutex_unlock( &h->lock );
+      heap_lock( owner );
+      h = owner;
+    }
+    heap_free( h, p );
+  }
+  if( h != NULL )
+    pthread_mutex_unlock( &h->lock );
+  b->low_water = MIN( b->low_water, b->count );
+}
+
+#if MM_REMOTE_FREE
+/*
+ * remote_free - push block p of arena h on its remote queue, a lock-free
+ * stack linked through the blocks' first payload word. any thread may
+ * push, taking one compare and swap when uncontended; only a thread that
+ * holds the arena's lock pops, and it takes the whole stack at once, so
+ * a block cannot come back to the head under a pusher (no ABA).
+ *
+ * void* p: ptr to first byte of block's payload
+ */
+static void remote_free( struct mm_heap *h, void *p )
+{
+  void *head = __atomic_load_n( &h->remote, __ATOMIC_RELAXED );
+
+  do
+    REMOTE_NEXT( p ) = head;
+  while( !__atomic_compare_exchange_n( &h->remote, &head, p, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED ) );
+}
+#endif
+
+/*
+ * remote_drain - free every block on the remote queue of arena h, whose
+ * lock the caller holds. each block goes through heap_free, so small
+ * blocks wait on the quick lists until the next consolidate.
+ */
+static inline void remote_drain( struct mm_heap *h )
+{
+  void *p, *next;
+
+  if( __atomic_load_n( &h->remote, __ATOMIC_RELAXED ) == NULL )
+    return;
+
+  for( p = __atomic_exchange_n( &h->remote, NULL, __ATOMIC_ACQUIRE ); p != NULL; p = next ){
+    next = REMOTE_NEXT( p );
+    STAT( h, remote_frees, 1 );
+    heap_free( h, p );
+  }
+}
+
+/*
+ * heap_lock - lock heap h and free the blocks on its remote queue. every
+ * path that allocs, frees or trims under the lock of a heap goes through
+ * here, so that blocks queued for an arena that its threads have left are
+ * not held until the next mm_trim.
+ */
+static inline void heap_lock( struct mm_heap *h )
+{
+  pthread_mutex_lock( &h->lock );
+  remote_drain( h );
+}
+
+#if MM_TCACHE
+/*
+ * tcache_gc - gc step of tc, run every TCACHE_GC_OPS calls of its thread.
+ * if mm_trim asked for it the whole cache is flushed. otherwise the next
+ * non empty bin in turn returns 3/4 of the blocks it did not use since
+ * its last gc step, so the bins of sizes a thread stopped using drain
+ * over a few steps while busy bins keep their blocks.
+ */
+static void tcache_gc( struct tcache *tc )
+{
+  struct tcache_bin *b;
+  int i;
+
+  tc->gc_countdown = TCACHE_GC_OPS;
+
+  if( __atomic_exchange_n( &tc->flush, 0, __ATOMIC_RELAXED ) ){
+    for( i = 0; i < TCACHE_BINS; i++ )
+      if( tc->bins[i].count > 0 )
+        tcache_flush( tc, i, tc->bins[i].count );
+    return;
+  }
+
+  for( i = 0; i < TCACHE_BINS; i++ ){
+    b = &tc->bins[tc->gc_bin];
+    tc->gc_bin = ( tc->gc_bin + 1 ) % TCACHE_BINS;
+    if( b->count == 0 )
+      continue;
+    if( b->low_water > 0 ){
+      tcache_flush( tc, b - tc->bins, b->low_water - b->low_water / 4 );
+      b->fill = MAX( b->fill / 2, 1 );
+    }
+    b->low_water = b->count;
+    return;
+  }
+}
+
+#endif
+
+/*
+ * tcache_key_init - create the key whose destructor flushes the cache of
+ * an exiting thread.
+ */
+static void tcache_key_init( void )
+{
+  pthread_key_create( &tcache_key, tcache_exit );
+}
+
+/*
+ * tcache_exit - flush the cache of an exiting thread, drain the remote
+ * queue of its arena, which may have no other thread left to drain it,
+ * and unregister its state. a thread that allocates again afterwards
+ * registers anew.
+ *
+ * void* arg: ptr to the thread's cache
+ */
+static void tcache_exit( void *arg )
+{
+  struct tcache *tc = arg;
+  int i;
+
+  if( tc->generation == __atomic_load_n( &generation, __ATOMIC_ACQUIRE ) ){
+    for( i = 0; i < TCACHE_BINS; i++ )
+      if( tc->bins[i].count > 0 )
+        tcache_flush( tc, i, tc->bins[i].count );
+    heap_lock( tc->arena );
+    pthread_mutex_unlock( &tc->arena->lock );
+  }
+
+  pthread_mutex_lock( &arenas_lock );
+  if( tc->registered ){
+    if( tc->prev != NULL )
+      tc->prev->next = tc->next;
+    else
+      tcaches = tc->next;
+    if( tc->next != NULL )
+      tc->next->prev = tc->prev;
+    tc->registered = 0;
+  }
+  tc->generation = 0;
+  pthread_mutex_unlock( &arenas_lock );
+}
+
+
+/*
+ * stats_add - add the statistics a of one arena to s, see mm_stats.
+ */
+static void stats_add( struct mm_stats *s, const struct mm_stats *a )
+{
+  int i;
+
+  s->mallocs += a->mallocs;
+  s->frees += a->frees;
+  s->remote_frees += a->remote_frees;
+  s->reallocs += a->reallocs;
+  for( i = 0; i < MM_REALLOC_PATHS; i++ )
+    s->realloc_paths[i] += a->realloc_paths[i];
+  s->splits += a->splits;
+  s->coalesce_prev += a->coalesce_prev;
+  s->coalesce_next += a->coalesce_next;
+  s->coalesce_both += a->coalesce_both;
+  s->sbrk_calls += a->sbrk_calls;
+  s->sbrk_bytes += a->sbrk_bytes;
+  s->trims += a->trims;
+  s->trim_bytes += a->trim_bytes;
+  s->mmaps += a->mmaps;
+  s->slab_runs += a->slab_runs;
+  s->fit_searches += a->fit_searches;
+  s->fit_probes += a->fit_probes;
+  s->quick_hits += a->quick_hits;
+  s->consolidations += a->consolidations;
+  s->live_bytes += a->live_bytes;
+  s->peak_bytes += a->peak_bytes;
+  s->heap_bytes += a->heap_bytes;
+  s->mmapped_bytes += a->mmapped_bytes;
+  for( i = 0; i < MM_STATS_CLASSES; i++ ){
+    s->free_blocks[i] += a->free_blocks[i];
+    s->free_bytes[i] += a->free_bytes[i];
+  }
+}
+
+/*
+ * realloc_in_place - resize heap block p to size without moving it. see
+ * heap_realloc for the order in which this is tried. the heap is not
+ * extended for sizes that heap_malloc would mmap, so that such a block
+ * moves to a mapping once and grows with mremap from then on.
+ *
+ * void* ptr: ptr to first byte of block's payload.
+ * size_t* size: desired payload size.
+ *
+ * returns: NULL if the block can not be resized in place, otherwise ptr
+ */
+static void *realloc_in_place( struct mm_heap *h, void *ptr, size_t size )
+{
+  size_t block_size = get_block_size( size );
+  size_t old_size = GET_SIZE( GET_HEADER( ptr ) );
+  void *next = GET_NEXT( ptr );
+  size_t next_size = GET_ALLOC( GET_HEADER( next ) ) ? 0 : GET_SIZE( GET_HEADER( next ) );
+
+  if( block_size <= old_size ){
+    if( old_size - block_size < MIN_BLOCK_SIZE ){
+      STAT( h, realloc_paths[MM_REALLOC_FITS], 1 );
+      return ptr;
+    }
+
+    place( ptr, block_size );
+    void *tail = GET_NEXT( ptr );
+    place_free( tail, old_size - block_size );
+    coalesce( h, tail, old_size - block_size );
+    STAT( h, splits, 1 );
+    STAT( h, realloc_paths[MM_REALLOC_SHRINK], 1 );
+    return ptr;
+  }
+
+  if( old_size + next_size >= block_size ){
+    seg_list_remove( h, next );
+    place( ptr, old_size + next_size );
+    split( h, ptr, block_size );
+    STAT( h, realloc_paths[MM_REALLOC_ABSORB], 1 );
+    return ptr;
+  }
+
+  if( size < h->mmap_threshold && IS_LAST( next_size ? next : ptr )
+      && grow_heap( h, block_size - old_size ) != NULL ){
+    place( ptr, old_size + GET_SIZE( GET_HEADER( next ) ) );
+    split( h, ptr, block_size );
+    STAT( h, realloc_paths[MM_REALLOC_EXTEND], 1 );
+    return ptr;
+  }
+
+  return NULL;
+}
+
+#if MM_SLAB
+/*
+ * slab_malloc - alloc an object of the class of size from the first run
+ * on the class's list, creating a run if there is none. the run leaves
+ * the list once full.
+ *
+ * size_t size: size of alloc request, at most SLAB_MAX
+ *
+ * returns: NULL if failure occurs, otherwise ptr to the object
+ */
+static void *slab_malloc( struct mm_heap *h, size_t size )
+{
+  int class = SLAB_CLASS( size );
+  struct slab_run *run = h->runs[class];
+  void *p;
+
+  if( run == NULL && ( run = run_create( h, class ) ) == NULL )
+    return NULL;
+
+  if( ( p = run->free ) != NULL )
+    run->free = SLAB_NEXT( p );
+  else
+    p = (char*)run + RUN_HEADER_SIZE + run->carved++ * run->size;
+
+  if( ++run->used == run->count ){
+    if( ( h->runs[class] = run->next ) != NULL )
+      run->next->prev = NULL;
+    run->next = NULL;
+  }
+
+  STAT( h, mallocs, 1 );
+  STAT_LIVE( h, run->size );
+  h->last = run;
+  h->last_freed = NULL;
+  return p;
+}
+
+/*
+ * run_create - make a run for objects of class, mark its page as a run in
+ * the page map and put it on the class's list.
+ *
+ * int class: slab class, 0 <= class < SLAB_CLASSES
+ *
+ * returns: NULL if failure occurs, otherwise ptr to the run
+ */
+static struct slab_run *run_create( struct mm_heap *h, int class )
+{
+  struct slab_run *run;
+
+  if( ( run = run_block( h ) ) == NULL )
+    return NULL;
+
+  pagemap_set( run, RUN_SIZE, PAGE_ENTRY( h, PAGE_RUN ) );
+  run->size = ( class + 1 ) * ALIGNMENT;
+  run->count = ( RUN_SIZE - RUN_HEADER_SIZE - WSIZE ) / run->size;
+  run->used = 0;
+  run->carved = 0;
+  run->free = NULL;
+  run->prev = NULL;
+  run->next = h->runs[class];
+  if( run->next != NULL )
+    run->next->prev = run;
+  h->runs[class] = run;
+  STAT( h, slab_runs, 1 );
+  return run;
+}
+
+/*
+ * run_gap - bytes from payload p to the first RUN_SIZE boundary that
+ * leaves either nothing or a block of at least MIN_BLOCK_SIZE before it.
+ */
+static inline size_t run_gap( void *p )
+{
+  size_t gap = -(unsigned long)p % RUN_SIZE;
+
+  return gap != 0 && gap < MIN_BLOCK_SIZE ? gap + RUN_SIZE : gap;
+}
+
+/*
+ * run_fit - find a free block that holds a run, i.e. RUN_SIZE bytes from
+ * its first RUN_SIZE boundary on (see run_gap), first fit from the class
+ * of RUN_SIZE up as in get_fit. the place of a released run fits exactly.
+ * in a size tree the blocks of the best fit size for RUN_SIZE are tried,
+ * then the best fit for any alignment. the TLSF engine only tries the
+ * first block of the class of RUN_SIZE, then takes a block of the first
+ * class that holds a run at any alignment.
+ *
+ * returns: NULL if no block fits, otherwise ptr to the free block
+ */
+static void *run_fit( struct mm_heap *h )
+{
+  int i = get_size_class( RUN_SIZE );
+  void *j;
+
+  STAT( h, fit_searches, 1 );
+
+#if MM_TLSF
+  if( ( j = GET_LINK( h, SEG_LIST_HEAD( h, i ) ) ) != NULL && GET_SIZE( GET_HEADER( j ) ) >= run_gap( j ) + RUN_SIZE )
+    return j;
+  if( ( i = class_find( h, fit_class( 2 * RUN_SIZE + MIN_BLOCK_SIZE ) ) ) < 0 )
+    return NULL;
+  return GET_LINK( h, SEG_LIST_HEAD( h, i ) );
+#else
+  for( i = class_find( h, i ); i >= 0; i = class_find( h, i + 1 ) ){
+    if( i >= SEG_TREE_CLASS ){
+      void *t = tree_fit( h, i, RUN_SIZE );
+
+      if( ( j = t ) != NULL )
+        do{
+          if( GET_SIZE( GET_HEADER( j ) ) >= run_gap( j ) + RUN_SIZE )
+            return j;
+        }while( ( j = TREE_LINK( h, j, TREE_FD ) ) != t );
+      if( ( j = tree_fit( h, i, 2 * RUN_SIZE + MIN_BLOCK_SIZE ) ) != NULL )
+        return j;
+    }else
+      for( j = GET_LINK( h, SEG_LIST_HEAD( h, i ) ); j != NULL; j = GET_NEXT_FREE( h, j ) ){
+        STAT( h, fit_probes, 1 );
+        if( GET_SIZE( GET_HEADER( j ) ) >= run_gap( j ) + RUN_SIZE )
+          return j;
+      }
+  }
+
+  return NULL;
+#endif
+}
+
+/*
+ * run_block - alloc a heap block of RUN_SIZE whose payload starts on a
+ * RUN_SIZE boundary. the block is cut from a free block, see run_fit, or
+ * else from the wilderness grown by just what the alignment needs, which
+ * is nothing when the last block is a run. the free block before the
+ * boundary and the remainder after the run go back to the seg_lists
+ * table.
+ *
+ * returns: NULL if failure occurs, otherwise ptr to the block's payload
+ */
+static void *run_block( struct mm_heap *h )
+{
+  char *tail = heap_tail( h );
+  char *end = tail == NULL ? h->mem_bp + 1 : tail;	//payload of a grown block
+  char *p;
+
+  if( ( p = run_fit( h ) ) != NULL )
+    seg_list_remove( h, p );
+  else if( ( p = grow_heap( h, run_gap( end ) + RUN_SIZE ) ) == NULL )
+    return NULL;
+
+  size_t size = GET_SIZE( GET_HEADER( p ) );
+  size_t gap = run_gap( p );
+  char *run = p + gap;
+
+  if( gap != 0 ){
+    place_free( p, gap );
+    seg_list_add( h, p );
+  }
+  place_free( run, size - gap );
+  split( h, run, RUN_SIZE );
+  return run;
+}
+#endif
+
+/*
+ * slab_free - free object p of a slab run. a run that was full goes back
+ * on its class's list; a run left empty is freed to the heap, unless it is
+ * the only run of its class with free objects, which keeps a class that
+ * is alloc'd and freed in turn from making and freeing a run each time.
+ *
+ * void* p: ptr to the object
+ */
+static void slab_free( struct mm_heap *h, void *p )
+{
+  struct slab_run *run = RUN_OF( p );
+  int class = SLAB_CLASS( run->size );
+
+  STAT( h, frees, 1 );
+  STAT_LIVE( h, -(size_t)run->size );
+  h->last = NULL;
+  h->last_freed = NULL;
+
+  SLAB_NEXT( p ) = run->free;
+  run->free = p;
+
+  if( run->used-- == run->count ){
+    run->prev = NULL;
+    run->next = h->runs[class];
+    if( run->next != NULL )
+      run->next->prev = run;
+    h->runs[class] = run;
+  }else if( run->used == 0 && ( run->prev != NULL || run->next != NULL ) ){
+    if( run->prev != NULL )
+      run->prev->next = run->next;
+    else
+      h->runs[class] = run->next;
+    if( run->next != NULL )
+      run->next->prev = run->prev;
+
+    pagemap_set( run, RUN_SIZE, PAGE_ENTRY( h, PAGE_BLOCKS ) );
+    STAT( h, slab_runs, -1 );
+    coalesce( h, run, GET_SIZE( GET_HEADER( run ) ) );
+  }
+}
+
+/*
+ * is_run - tell whether p lies in a slab run, from the page map entry of
+ * its page.
+ *
+ * void* p: ptr to first byte of block's payload or object
+ *
+ * returns: 1 if p is an object of a run, 0 otherwise
+ */
+static inline int is_run( void *p )
+{
+#if MM_SLAB
+  return PAGE_KIND( pagemap_get( p ) ) == PAGE_RUN;
+#else
+  return 0;
+#endif
+}
+
+#if MM_TCACHE
+/*
+ * usable_size - payload size an alloc request of size gets: the size of
+ * its slab class, or the payload of its heap block. only asked for sizes
+ * below any mmap threshold.
+ *
+ * size_t size: size of alloc request
+ *
+ * returns: size_t payload size
+ */
+static inline size_t usable_size( size_t size )
+{
+#if MM_SLAB
+  if( size <= SLAB_MAX )
+    return ALIGN( size );
+#endif
+  return get_block_size( size ) - WSIZE;
+}
+#endif
+
+/*
+ * block_usable - payload size of block or object p, or 0 for an mmapped
+ * block, which no thread cache keeps. the caller may not hold the lock of
+ * p's heap, whose holder can flip PREV_ALLOC in p's header meanwhile, so
+ * the header is read atomically; its size does not change.
+ *
+ * unsigned long e: page map entry of p, see pagemap_get
+ * void* p: ptr to first byte of block's payload or object
+ *
+ * returns: size_t payload size
+ */
+static inline size_t block_usable( unsigned long e, void *p )
+{
+  if( PAGE_KIND( e ) == PAGE_RUN )
+    return RUN_OF( p )->size;
+  if( PAGE_KIND( e ) == PAGE_MMAP )
+    return 0;
+  return ( GET_ATOMIC( GET_HEADER( p ) ) & ~0x7 ) - WSIZE;
+}
+
+/*
+ * pagemap_get - page map entry of the page of p: its owning heap and page
+ * kind, or 0 for a page no heap handed out. the root is indexed by the
+ * page number's top bits and a mid and a leaf node by the next ones; the
+ * nodes are never freed once installed, so lookups take no lock. an entry
+ * does not change while a block of its page is alloc'd, which is all a
+ * caller asks of it, so the entry itself needs no ordering.
+ *
+ * void* p: any address
+ *
+ * returns: unsigned long entry, see PAGE_ENTRY
+ */
+static inline unsigned long pagemap_get( void *p )
+{
+  unsigned long page = PAGE_OF( p );
+  void **mid = __atomic_load_n( &pagemap[page >> ( PAGEMAP_MID_BITS + PAGEMAP_LEAF_BITS ) &
+                                         ( PAGEMAP_SIZE( PAGEMAP_ROOT_BITS ) - 1 )], __ATOMIC_ACQUIRE );
+  unsigned long *leaf;
+
+  if( mid == NULL )
+    return 0;
+  if( ( leaf = __atomic_load_n( &mid[page >> PAGEMAP_LEAF_BITS & ( PAGEMAP_SIZE( PAGEMAP_MID_BITS ) - 1 )],
+                                __ATOMIC_ACQUIRE ) ) == NULL )
+    return 0;
+  return __atomic_load_n( &leaf[page & ( PAGEMAP_SIZE( PAGEMAP_LEAF_BITS ) - 1 )], __ATOMIC_RELAXED );
+}
+
+/*
+ * pagemap_set - set the page map entry of every page from start through
+ * start + len - 1 to e. mid and leaf nodes are mapped as needed, except
+ * when clearing entries (e is 0), which skips pages without a node.
+ *
+ * void* start: first address
+ * size_t len: bytes from start on
+ * unsigned long e: entry, see PAGE_ENTRY
+ *
+ * returns: 0 if successful, -1 if the range is beyond the page map or a
+ * node could not be mapped
+ */
+static int pagemap_set( void *start, size_t len, unsigned long e )
+{
+  unsigned long page = PAGE_OF( start ), last = PAGE_OF( (char*)start + len - 1 );
+  void **mid;
+  unsigned long *leaf;
+
+  if( len == 0 )
+    return 0;
+  if( last >> PAGEMAP_BITS || last < page )
+    return -1;
+
+  while( page <= last ){
+    mid = pagemap_node( &pagemap[page >> ( PAGEMAP_MID_BITS + PAGEMAP_LEAF_BITS )],
+                        PAGEMAP_SIZE( PAGEMAP_MID_BITS ) * sizeof( void* ), e != 0 );
+    leaf = mid == NULL ? NULL :
+      pagemap_node( &mid[page >> PAGEMAP_LEAF_BITS & ( PAGEMAP_SIZE( PAGEMAP_MID_BITS ) - 1 )],
+                    PAGEMAP_SIZE( PAGEMAP_LEAF_BITS ) * sizeof( unsigned long ), e != 0 );
+
+    if( leaf == NULL ){
+      if( e != 0 )
+        return -1;
+      page = ( page | ( PAGEMAP_SIZE( PAGEMAP_LEAF_BITS ) - 1 ) ) + 1;
+      continue;
+    }
+    do
+      __atomic_store_n( &leaf[page & ( PAGEMAP_SIZE( PAGEMAP_LEAF_BITS ) - 1 )], e, __ATOMIC_RELAXED );
+    while( ++page <= last && page & ( PAGEMAP_SIZE( PAGEMAP_LEAF_BITS ) - 1 ) );
+  }
+  return 0;
+}
+
+/*
+ * pagemap_node - node of the page map that slot points at, mapping and
+ * installing a zeroed one of size bytes if there is none and create is
+ * set. threads of different heaps may race to install the same node: the
+ * compare and swap lets one win and the others unmap theirs.
+ *
+ * returns: NULL if there is no node or it could not be mapped, otherwise
+ * ptr to the node
+ */
+static void *pagemap_node( void **slot, size_t size, int create )
+{
+  void *node = __atomic_load_n( slot, __ATOMIC_ACQUIRE ), *fresh;
+
+  if( node != NULL || !create )
+    return node;
+
+  if( ( fresh = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 ) ) == MAP_FAILED )
+    return NULL;
+  if( !__atomic_compare_exchange_n( slot, &node, fresh, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) ){
+    munmap( fresh, size );
+    return node;
+  }
+  return fresh;
+}
+
+/*
+ * place - update block's header with alloc bit and size, keeping its
+ * PREV_ALLOC bit, and set PREV_ALLOC in the next block's header. an
+ * alloc'd block has no footer.
+ *
+ * void* ptr: ptr to first byte of block's payload.
+ * size_t* size: desired block size.
+ *
+ */
+static void place( void* p, size_t size ){
+  if ( p == NULL || size == 0 )
+    return;
+
+  PUT( GET_HEADER( p ), PACK( size, GET_PREV_ALLOC( GET_HEADER( p ) ) | 1 ) );
+  SET_PREV_ALLOC( GET_HEADER( GET_NEXT( p ) ) );
+}
+
+/*
+ * place_free - write header and footer of free block p of size, keeping
+ * its PREV_ALLOC bit, and clear PREV_ALLOC in the next block's header.
+ *
+ * void* ptr: ptr to first byte of block's payload.
+ * size_t* size: block size.
+ *
+ */
+static void place_free( void *p, size_t size )
+{
+  PUT( GET_HEADER( p ), PACK( size, GET_PREV_ALLOC( GET_HEADER( p ) ) ) );
+  PUT( GET_FOOTER( p ), PACK( size, 0 ) );
+  CLEAR_PREV_ALLOC( GET_HEADER( GET_NEXT( p ) ) );
+}
+
+/*
+ * split - alloc the first size bytes of block p, which must not be on the
+ * seg_lists table. any remainder large enough to form a block is
+ * returned to seg_lists table as a free block, otherwise the whole block
+ * stays alloc'd.
+ *
+ * void* ptr: ptr to first byte of block's payload.
+ * size_t* size: desired block size.
+ *
+ */
+static void split( struct mm_heap *h, void *p, size_t size )
+{
+  size_t split_remainder = GET_SIZE( GET_HEADER( p ) ) - size;
+
+  if( split_remainder >= MIN_BLOCK_SIZE ){
+    place( p, size );
+    void *tail = GET_NEXT( p );
+    place_free( tail, split_remainder );
+    seg_list_add( h, tail );
+    STAT( h, splits, 1 );
+  }else{
+    place( p, GET_SIZE( GET_HEADER( p ) ) );
+  }
+}
+
+/*
+ * get_block_size - calculate block size needed for an alloc request,
+ * including header, aligned and at least MIN_BLOCK_SIZE.
+ *
+ * size_t size: size of alloc request
+ *
+ * returns: size_t block size
+ */
+static size_t get_block_size( size_t size )
+{
+  return MAX( ALIGN( size + WSIZE ), MIN_BLOCK_SIZE );
+}
+
+/*
+ * get_size_class - calculate size class lookup of seg_lists table. the
+ * leading bit of size picks the power of two range and the next
+ * SEG_CLASS_BITS bits pick the sub-class within it, e.g. with 4 sub-classes
+ * 64, 80, 96 and 112 start the classes of the 64..127 range. sizes above
+ * the last class share the last list.
+ *
+ * size_t* size: desired block size.
+ *
+ * returns: int, where 0 <= size class < SEG_LIST_COUNT
+ */
+static int get_size_class( size_t size )
+{
+  unsigned long s = MAX( size, MIN_BLOCK_SIZE );
+  int msb = ( sizeof( long ) * 8 - 1 ) - __builtin_clzl( s );
+  int sub = ( s >> ( msb - SEG_CLASS_BITS ) ) & ( SEG_SUBCLASSES - 1 );
+  int class = ( ( msb - MIN_BLOCK_SHIFT ) << SEG_CLASS_BITS ) + sub;
+
+  return class < SEG_LIST_COUNT ? class : SEG_LIST_COUNT - 1;
+}
+
+/*
+ * get_fit - find free block of size from seg_lists table.
+ * implementation based on first fit strategy, starting from
+ * seg_list fit size class. empty classes are skipped with a find
+ * first set on seg_bitmap rather than visiting their list heads.
+ * classes from SEG_TREE_CLASS on keep a size tree rather than a list,
+ * which gives the best fit of the class, see tree_fit.
+ *
+ * the TLSF engine makes no list walk: after the first block of the
+ * class of size, it takes the first block of the first non empty class
+ * from fit_class( size ) on, whose blocks all fit (good fit). a block
+ * further down the class of size is missed, for a bounded search.
+ *
+ * size_t* size: desired block size.
+ *
+ * returns:  8 byte ptr to first payload byte address of fit block.
+ */
+
+static void* get_fit( struct mm_heap *h, size_t size )
+{
+  int i = get_size_class( size );
+  void* j;
+
+  STAT( h, fit_searches, 1 );
+
+#if MM_TLSF
+  if( ( j = GET_LINK( h, SEG_LIST_HEAD( h, i ) ) ) != NULL ){
+    STAT( h, fit_probes, 1 );
+    if( GET_SIZE( GET_HEADER( j ) ) >= size )
+      return j;
+  }
+  if( ( i = class_find( h, fit_class( size ) ) ) < 0 )
+    return NULL;
+  STAT( h, fit_probes, 1 );
+  return GET_LINK( h, SEG_LIST_HEAD( h, i ) );
+#else
+  for( i = class_find( h, i ); i >= 0; i = class_find( h, i + 1 ) ){
+    if( i >= SEG_TREE_CLASS ){
+      if( ( j = tree_fit( h, i, size ) ) != NULL )
+        return j;
+      continue;
+    }
+
+    for ( j = GET_LINK( h, SEG_LIST_HEAD( h, i ) ); INSIDE_HEAP( h, j ) && j != 0; ) {
+
+      STAT( h, fit_probes, 1 );
+      if( !GET_ALLOC( GET_HEADER( j ) ) && GET_SIZE( GET_HEADER( j ) ) >= size )
+        return j;
+
+      j = GET_NEXT_FREE( h, j );
+    }
+  }
+
+  return NULL;
+#endif
+}
+
+/*
+ * grow_heap - extend heap so that a free block of at least size sits at
+ * the end of heap. a free block already at the end of heap (the
+ * wilderness) is removed from seg_lists table and merged with the new
+ * space, so only the missing bytes are requested. the heap grows by at
+ * least CHUNKSIZE or heap size >> GROW_SHIFT, whichever is larger, but
+ * no further than the region has room for, and falls back to the
+ * missing bytes alone if that fails. the new pages are entered in the
+ * page map. the new block takes over the old epilogue header and a new
+ * epilogue is written after it.
+ *
+ * size_t* size: desired block size.
+ *
+ * returns: NULL if failure occurs, otherwise 8 byte ptr to address of free block's first payload
+ * byte. the block is not on seg_lists table.
+ */
+static void *grow_heap( struct mm_heap *h, size_t size )
+{
+  if( size == 0 )
+    return NULL;
+
+  void* tail = heap_tail( h );
+  size_t tail_size = tail == NULL ? 0 : GET_SIZE( GET_HEADER( tail ) );
+  size_t need = size > tail_size ? size - tail_size : 0;
+  size_t room = ( mem_region_maxheap( h->region ) - mem_region_heapsize( h->region ) ) & ~( ALIGNMENT - 1 );
+  size_t incr = MAX( CHUNKSIZE, ALIGN( mem_region_heapsize( h->region ) >> GROW_SHIFT ) );
+
+  incr = MAX( need, MIN( incr, room ) );
+
+  void* ptr =  mem_region_sbrk( h->region, incr );
+
+  if( (long)ptr == -1 && incr > need )
+    ptr = mem_region_sbrk( h->region, incr = need );
+
+  if( (long)ptr == -1 )
+    return NULL;
+
+  if( pagemap_set( ptr, incr, PAGE_ENTRY( h, PAGE_BLOCKS ) ) < 0 ){
+    mem_region_shrink_brk( h->region, incr );
+    return NULL;
+  }
+
+  STAT( h, sbrk_calls, 1 );
+  STAT( h, sbrk_bytes, incr );
+
+  if( tail_size ){
+    seg_list_remove( h, tail );
+    ptr = tail;
+  }
+
+  PUT( (char*)ptr + tail_size + incr - WSIZE, PACK( 0, 1 ) );
+  place_free( ptr, tail_size + incr );
+
+  h->mem_bp = mem_region_heap_hi( h->region );
+  return ptr;
+
+}
+
+/*
+ * heap_tail - free block at the end of heap (the wilderness), found from
+ * the epilogue's PREV_ALLOC bit and the block's footer.
+ *
+ * returns: NULL if the last block is alloc'd, otherwise ptr to the block
+ */
+static inline void *heap_tail( struct mm_heap *h )
+{
+  char *end = h->mem_bp + 1;
+
+  return GET_PREV_ALLOC( GET_HEADER( end ) ) ? NULL : GET_PREV( end );
+}
+
+/*
+ * mmap_chunk - map a block of its own for a request of size. the mapping
+ * starts with a struct mmap_chunk that links it on the heap's mmaps list,
+ * and the block header carries MMAP_BIT so that heap_free and heap_realloc
+ * can tell it from a heap block. the first page, which holds the block's
+ * payload ptr, is entered in the page map.
+ *
+ * size_t size: size of alloc request
+ *
+ * returns: NULL if failure occurs, otherwise ptr to block's first payload byte.
+ */
+static void *mmap_chunk( struct mm_heap *h, size_t size )
+{
+  size_t page = mem_pagesize();
+  size_t len = ( size + MMAP_HEADER_SIZE + page - 1 ) & ~( page - 1 );
+
+  if( len < size )
+    return NULL;
+
+  char *base = mmap( NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  if( base == MAP_FAILED )
+    return NULL;
+  if( pagemap_set( base, 1, PAGE_ENTRY( h, PAGE_MMAP ) ) < 0 ){
+    munmap( base, len );
+    return NULL;
+  }
+
+  struct mmap_chunk *c = (struct mmap_chunk*)base;
+  c->len = len;
+  c->heap = h;
+  c->prev = NULL;
+  c->next = h->mmaps;
+  if( h->mmaps != NULL )
+    h->mmaps->prev = c;
+  h->mmaps = c;
+  h->mmapped += len;
+  STAT( h, mmaps, 1 );
+
+  void *p = MMAP_PAYLOAD( c );
+  PUT( GET_HEADER( p ), PACK( 0, MMAP_BIT | 1 ) );
+  return p;
+}
+
+/*
+ * munmap_chunk - unmap block of ptr. unless mm_heap_set_mmap_threshold was
+ * called, a mapping larger than mmap_threshold (up to MMAP_THRESHOLD_MAX)
+ * raises mmap_threshold to its length and trim_threshold to twice that,
+ * so that the heap serves such sizes from then on and keeps them.
+ *
+ * void* ptr: ptr to first byte of mmapped block's payload.
+ *
+ */
+static void munmap_chunk( struct mm_heap *h, void *p )
+{
+  struct mmap_chunk *c = MMAP_CHUNK( p );
+  size_t len = c->len;
+
+  if( c->prev != NULL )
+    c->prev->next = c->next;
+  else
+    h->mmaps = c->next;
+  if( c->next != NULL )
+    c->next->prev = c->prev;
+  h->mmapped -= len;
+
+  if( !h->mmap_threshold_fixed && len > h->mmap_threshold && len <= MMAP_THRESHOLD_MAX ){
+    h->mmap_threshold = len;
+    h->trim_threshold = 2 * len;
+  }
+
+  pagemap_set( c, 1, 0 );
+  munmap( c, len );
+}
+
+/*
+ * munmap_chunks - unmap every mmapped block of heap h, whether or not it
+ * was freed, for a heap that is destroyed or rebuilt.
+ */
+static void munmap_chunks( struct mm_heap *h )
+{
+  struct mmap_chunk *c;
+
+  while( ( c = h->mmaps ) != NULL ){
+    h->mmaps = c->next;
+    pagemap_set( c, 1, 0 );
+    munmap( c, c->len );
+  }
+  h->mmapped = 0;
+}
+
+/*
+ * mremap_chunk - resize mmapped block of ptr with mremap, which moves the
+ * pages rather than copying them if the mapping can not grow in place.
+ * a move goes onto a mapping made first, whose first page enters the
+ * page map before the block moves, so that the block is left untouched
+ * when the page map can not take it. the old first page leaves the page
+ * map before the move, since once unmapped it may be handed out to
+ * another heap.
+ *
+ * void* ptr: ptr to first byte of mmapped block's payload.
+ * size_t* size: desired payload size.
+ *
+ * returns: NULL if failure occurs, otherwise ptr to resized block's first payload byte.
+ */
+static void *mremap_chunk( struct mm_heap *h, void *p, size_t size )
+{
+  size_t page = mem_pagesize();
+  struct mmap_chunk *c = MMAP_CHUNK( p );
+  size_t len = c->len;
+  size_t new_len = ( size + MMAP_HEADER_SIZE + page - 1 ) & ~( page - 1 );
+
+  if( new_len < size )
+    return NULL;
+
+  if( new_len == len ){
+    STAT( h, realloc_paths[MM_REALLOC_FITS], 1 );
+    return p;
+  }
+
+  char *base = mremap( c, len, new_len, 0 ), *dst;
+  if( base == MAP_FAILED ){
+    dst = mmap( NULL, new_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( dst == MAP_FAILED )
+      return NULL;
+    if( pagemap_set( dst, 1, PAGE_ENTRY( h, PAGE_MMAP ) ) < 0 ){
+      munmap( dst, new_len );
+      return NULL;
+    }
+    pagemap_set( c, 1, 0 );
+    base = mremap( c, len, new_len, MREMAP_MAYMOVE | MREMAP_FIXED, dst );
+    if( base == MAP_FAILED ){
+      pagemap_set( c, 1, PAGE_ENTRY( h, PAGE_MMAP ) );
+      pagemap_set( dst, 1, 0 );
+      munmap( dst, new_len );
+      return NULL;
+    }
+  }
+
+  c = (struct mmap_chunk*)base;
+  c->len = new_len;
+  h->mmapped += new_len - len;
+  if( c->prev != NULL )
+    c->prev->next = c;
+  else
+    h->mmaps = c;
+  if( c->next != NULL )
+    c->next->prev = c;
+
+  p = MMAP_PAYLOAD( c );
+  STAT( h, realloc_paths[MM_REALLOC_REMAP], 1 );
+  return p;
+}
+
+/*
+ * trim_heap - shrink the heap under a free block at the end of heap (the
+ * wilderness) so that at most pad bytes, rounded up to a page, stay free
+ * there. the block shrinks, or disappears in which case its header
+ * becomes the epilogue.
+ *
+ * size_t pad: free bytes to keep at the end of heap.
+ *
+ * returns: 1 if the heap was shrunk, 0 otherwise
+ */
+static int trim_heap( struct mm_heap *h, size_t pad )
+{
+  void* tail = heap_tail( h );
+
+  if( tail == NULL || GET_SIZE( GET_HEADER( tail ) ) <= pad )
+    return 0;
+
+  size_t page = mem_pagesize();
+  size_t tail_size = GET_SIZE( GET_HEADER( tail ) );
+  size_t release = ( tail_size - pad ) & ~( page - 1 );
+
+  if( tail_size - release > 0 && tail_size - release < MIN_BLOCK_SIZE )
+    release -= page;
+
+  if( release == 0 )
+    return 0;
+
+  seg_list_remove( h, tail );
+
+  if( mem_region_shrink_brk( h->region, release ) == ( void * ) -1 ){
+    seg_list_add( h, tail );
+    return 0;
+  }
+
+  if( tail_size > release ){
+    PUT( (char*)tail + tail_size - release - WSIZE, PACK( 0, 1 ) );
+    place_free( tail, tail_size - release );
+    seg_list_add( h, tail );
+  }else{
+    PUT( GET_HEADER( tail ), PACK( 0, GET_PREV_ALLOC( GET_HEADER( tail ) ) | 1 ) );
+  }
+
+  h->mem_bp = mem_region_heap_hi( h->region );
+  STAT( h, trims, 1 );
+  STAT( h, trim_bytes, release );
+  return 1;
+}
+
+/*
+ * coalesce - free block of ptr and of size. combine with neighboring blocks
+ * if free, the previous one only if the block's PREV_ALLOC bit is clear,
+ * as only then does it have a footer to step back with. when the result
+ * is the wilderness and has reached trim_threshold, the heap is trimmed
+ * down to TOP_PAD free bytes. the gap between the two keeps a free/alloc
+ * pattern around the end of heap from trimming and growing the heap on
+ * every call.
+ *
+ * void* ptr: ptr to first byte of block's payload.
+ * size_t* size: desired block size.
+ *
+ */
+
+static void coalesce( struct mm_heap *h, void *p, size_t size )
+{
+  if ( p == NULL || size == 0 )
+    return;
+
+  int prev_elig = !GET_PREV_ALLOC( GET_HEADER( p ) );
+  int next_elig = ( INSIDE_HEAP( h, GET_NEXT( p ) ) && !GET_ALLOC( GET_HEADER( GET_NEXT( p ) ) ) );
+  void* start_p = p;
+  size_t free_size = size;
+
+  if( prev_elig ){
+    free_size += GET_SIZE( GET_HEADER( GET_PREV( p ) ) );
+    seg_list_remove( h, GET_PREV( p ) );
+    start_p = GET_PREV( p );
+  }
+
+  if( next_elig ){
+    free_size += GET_SIZE( GET_HEADER( GET_NEXT( p ) ) );
+    seg_list_remove( h, GET_NEXT( p ) );
+
+  }
+
+  if( prev_elig && next_elig )
+    STAT( h, coalesce_both, 1 );
+  else if( prev_elig )
+    STAT( h, coalesce_prev, 1 );
+  else if( next_elig )
+    STAT( h, coalesce_next, 1 );
+
+  place_free( start_p, free_size );
+  seg_list_add( h, start_p );
+  h->last_freed = start_p;
+
+  if( free_size >= h->trim_threshold && IS_LAST( start_p ) )
+    trim_heap( h, TOP_PAD );
+}
+
+#if MM_QUICK
+/*
+ * quick_pop - take a block of exactly size bytes off its quick list. the
+ * block is still marked alloc'd, so it is returned as it is.
+ *
+ * size_t size: block size, at most QUICK_MAX
+ *
+ * returns: NULL if the list is empty, otherwise ptr to the block
+ */
+static inline void *quick_pop( struct mm_heap *h, size_t size )
+{
+  void **head = &h->quick[QUICK_LIST( size )];
+  void *p = *head;
+
+  if( p == NULL )
+    return NULL;
+  *head = QUICK_NEXT( p );
+  h->quick_bytes -= size;
+  STAT( h, quick_hits, 1 );
+  return p;
+}
+
+/*
+ * quick_push - put freed block p of size bytes on its quick list, linked
+ * through its first payload word and left marked alloc'd, so that neither
+ * its neighbours nor the PREV_ALLOC bit of the next block change. the
+ * lists are consolidated once they hold more than QUICK_BYTES.
+ *
+ * void* p: ptr to first byte of block's payload
+ * size_t size: block size, at most QUICK_MAX
+ */
+static inline void quick_push( struct mm_heap *h, void *p, size_t size )
+{
+  void **head = &h->quick[QUICK_LIST( size )];
+
+  QUICK_NEXT( p ) = *head;
+  *head = p;
+  if( ( h->quick_bytes += size ) > QUICK_BYTES )
+    consolidate( h );
+}
+#endif
+
+/*
+ * consolidate - free every block on the quick lists of h through coalesce,
+ * merging it with its free neighbours. a quick block next to another
+ * merges with it when the second one's turn comes, as until then it looks
+ * alloc'd.
+ *
+ * returns: 1 if blocks were freed, 0 if the quick lists were empty
+ */
+static int consolidate( struct mm_heap *h )
+{
+#if MM_QUICK
+  void *p;
+  int i;
+
+  if( h->quick_bytes == 0 )
+    return 0;
+  for( i = 0; i < QUICK_LISTS; i++ )
+    while( ( p = h->quick[i] ) != NULL ){
+      h->quick[i] = QUICK_NEXT( p );
+      coalesce( h, p, GET_SIZE( GET_HEADER( p ) ) );
+    }
+  h->quick_bytes = 0;
+  STAT( h, consolidations, 1 );
+  return 1;
+#else
+  (void)h;
+  return 0;
+#endif
+}
+
+/*
+ * get_class_min - smallest block size of seg_lists class, the inverse
+ * of get_size_class.
+ *
+ * int class: size class, 0 <= class < SEG_LIST_COUNT
+ *
+ * returns: size_t smallest block size of the class
+ */
+static size_t get_class_min( int class )
+{
+  int msb = ( class >> SEG_CLASS_BITS ) + MIN_BLOCK_SHIFT;
+  int sub = class & ( SEG_SUBCLASSES - 1 );
+
+  return ( (size_t)1 << msb ) + ( (size_t)sub << ( msb - SEG_CLASS_BITS ) );
+}
+
+/*
+ * fit_class - first class whose every block holds size, the class of
+ * size unless size is above the class's smallest block.
+ *
+ * returns: int, where 0 <= class <= SEG_LIST_COUNT
+ */
+static inline int fit_class( size_t size )
+{
+  int class = get_size_class( size );
+
+  return get_class_min( class ) < size ? class + 1 : class;
+}
+
+/*
+ * class_mark - mark seg_lists class non empty. the TLSF engine keeps two
+ * levels of bitmap: a first level bit per power of two range, set when
+ * the second level word of its sub-classes is non zero.
+ */
+static inline void class_mark( struct mm_heap *h, int class )
+{
+#if MM_TLSF
+  h->sl_bitmap[class >> SEG_CLASS_BITS] |= 1U << ( class & ( SEG_SUBCLASSES - 1 ) );
+  h->fl_bitmap |= 1U << ( class >> SEG_CLASS_BITS );
+#else
+  h->seg_bitmap |= SEG_BIT( class );
+#endif
+}
+
+/*
+ * class_unmark - mark seg_lists class empty, see class_mark.
+ */
+static inline void class_unmark( struct mm_heap *h, int class )
+{
+#if MM_TLSF
+  if( ( h->sl_bitmap[class >> SEG_CLASS_BITS] &= ~( 1U << ( class & ( SEG_SUBCLASSES - 1 ) ) ) ) == 0 )
+    h->fl_bitmap &= ~( 1U << ( class >> SEG_CLASS_BITS ) );
+#else
+  h->seg_bitmap &= ~SEG_BIT( class );
+#endif
+}
+
+/*
+ * class_marked - tell whether seg_lists class is marked non empty.
+ */
+static inline int class_marked( struct mm_heap *h, int class )
+{
+#if MM_TLSF
+  return h->sl_bitmap[class >> SEG_CLASS_BITS] >> ( class & ( SEG_SUBCLASSES - 1 ) ) & 1;
+#else
+  return ( h->seg_bitmap & SEG_BIT( class ) ) != 0;
+#endif
+}
+
+/*
+ * class_find - first non empty seg_lists class from class on, with a find
+ * first set on each bitmap level: at most two with the TLSF engine.
+ *
+ * int class: size class, 0 <= class <= SEG_LIST_COUNT
+ *
+ * returns: the class, or -1 if every class from class on is empty
+ */
+static inline int class_find( struct mm_heap *h, int class )
+{
+  if( class >= SEG_LIST_COUNT )
+    return -1;
+#if MM_TLSF
+  int fl = class >> SEG_CLASS_BITS;
+  unsigned int sl = h->sl_bitmap[fl] & ( ~0U << ( class & ( SEG_SUBCLASSES - 1 ) ) );
+
+  if( sl == 0 ){
+    unsigned int fls = h->fl_bitmap & ( ~0U << fl << 1 );
+
+    if( fls == 0 )
+      return -1;
+    fl = __builtin_ctz( fls );
+    sl = h->sl_bitmap[fl];
+  }
+  return ( fl << SEG_CLASS_BITS ) + __builtin_ctz( sl );
+#else
+  unsigned long long avail = h->seg_bitmap & ( ~0ULL << class );
+
+  return avail ? __builtin_ctzll( avail ) : -1;
+#endif
+}
+
+/*
+ * seg_list_remove - remove free block from seg_lists table. the block's
+ * neighbours in its class list are linked to each other directly. blocks
+ * of classes from SEG_TREE_CLASS on are removed from the class's tree.
+ *
+ * void* ptr: ptr to first byte of block's payload.
+ *
+ */
+static void seg_list_remove( struct mm_heap *h, void *p )
+{
+  if ( p == NULL )
+    return;
+
+  int class_size = get_size_class( GET_SIZE( GET_HEADER( p ) ) );
+  if( class_size >= SEG_TREE_CLASS ){
+    tree_remove( h, p, class_size );
+    return;
+  }
+  void* next = GET_NEXT_FREE( h, p );
+  void* prev = GET_PREV_FREE( h, p );
+
+  if( prev != 0 )
+    PUT_NEXT_FREE( h, prev, next );
+  else
+    PUT_LINK( h, SEG_LIST_HEAD( h, class_size ), next );
+
+  if( prev == 0 && next == 0 )
+    class_unmark( h, class_size );
+
+  if( next != 0 )
+    PUT_PREV_FREE( h, next, prev );
+
+  PUT_NEXT_FREE( h, p, 0 );
+  PUT_PREV_FREE( h, p, 0 );
+}
+
+/*
+ * seg_list_add - add free block to seg_lists table. block will be pushed
+ * on top of stack for given size class, or inserted in the class's size
+ * tree from SEG_TREE_CLASS on.
+ *
+ *  * void* ptr: ptr to first byte of block's payload.
+ *
+ */
+
+static void seg_list_add( struct mm_heap *h, void *p )
+{
+  if ( p == NULL )
+    return;
+  int class_size = get_size_class( GET_SIZE( GET_HEADER( p ) ) );
+  if( class_size >= SEG_TREE_CLASS ){
+    tree_insert( h, p, class_size );
+    return;
+  }
+  void* head = GET_LINK( h, SEG_LIST_HEAD( h, class_size ) );
+
+  PUT_NEXT_FREE( h, p, head );
+  PUT_PREV_FREE( h, p, 0 );
+
+  if( head != 0 )
+    PUT_PREV_FREE( h, head, p );
+
+  PUT_LINK( h, SEG_LIST_HEAD( h, class_size ), p );
+  class_mark( h, class_size );
+}
+
+/*
+ * tree_key - key of size in the size tree of class: its bits from the
+ * highest one that varies among the sizes of the class on, shifted to the
+ * top. all but the last class hold sizes that share their leading bit and
+ * sub-class bits, the last one any size.
+ */
+static inline unsigned int tree_key( int class, size_t size )
+{
+  int msb = ( class >> SEG_CLASS_BITS ) + MIN_BLOCK_SHIFT;
+
+  if( class == SEG_LIST_COUNT - 1 )
+    return size;
+  return (unsigned int)size << ( 32 - msb + SEG_CLASS_BITS );
+}
+
+/*
+ * tree_insert - insert free block p in the size tree of class, whose root
+ * is the class's seg_lists head. the tree is a bitwise trie on the size's
+ * key (see tree_key): a node at depth d has the key bits above bit 31 - d
+ * of the path that leads to it, and its children are the subtrees whose
+ * bit 31 - d is 0 and 1. any node of a subtree can sit at its top, so no
+ * rebalancing is needed and the depth stays below the bits that vary in
+ * the class. blocks of a size already in the tree are chained on a
+ * circular list off its node instead of becoming nodes of their own.
+ *
+ * void* p: ptr to first byte of block's payload.
+ *
+ */
+static void tree_insert( struct mm_heap *h, void *p, int class )
+{
+  size_t size = GET_SIZE( GET_HEADER( p ) );
+  unsigned int key = tree_key( class, size );
+  char *t = GET_LINK( h, SEG_LIST_HEAD( h, class ) );
+  int depth;
+
+  PUT_TREE_LINK( h, p, TREE_FD, p );
+  PUT_TREE_LINK( h, p, TREE_BK, p );
+  PUT_TREE_LINK( h, p, TREE_CHILD( 0 ), 0 );
+  PUT_TREE_LINK( h, p, TREE_CHILD( 1 ), 0 );
+  PUT_TREE_LINK( h, p, TREE_PARENT, 0 );
+
+  if( t == NULL ){
+    PUT_LINK( h, SEG_LIST_HEAD( h, class ), p );
+    class_mark( h, class );
+    return;
+  }
+
+  for( depth = 0; GET_SIZE( GET_HEADER( t ) ) != size; depth++ ){
+    int b = TREE_BIT( key, depth );
+    char *c = TREE_LINK( h, t, TREE_CHILD( b ) );
+
+    if( c == NULL ){
+      PUT_TREE_LINK( h, t, TREE_CHILD( b ), p );
+      PUT_TREE_LINK( h, p, TREE_PARENT, t );
+      return;
+    }
+    t = c;
+  }
+
+  char *fd = TREE_LINK( h, t, TREE_FD );
+  PUT_TREE_LINK( h, p, TREE_FD, fd );
+  PUT_TREE_LINK( h, p, TREE_BK, t );
+  PUT_TREE_LINK( h, fd, TREE_BK, p );
+  PUT_TREE_LINK( h, t, TREE_FD, p );
+}
+
+/*
+ * tree_remove - remove free block p from the size tree of class. a chained
+ * block is unlinked from its chain; a node is replaced by a block of its
+ * chain, or else by a leaf of its subtrees, which has the node's path too.
+ *
+ * void* p: ptr to first byte of block's payload.
+ *
+ */
+static void tree_remove( struct mm_heap *h, void *p, int class )
+{
+  char *parent = TREE_LINK( h, p, TREE_PARENT );
+  char *r = NULL;
+
+  if( TREE_LINK( h, p, TREE_BK ) != p ){
+    char *fd = TREE_LINK( h, p, TREE_FD );
+
+    r = TREE_LINK( h, p, TREE_BK );
+    PUT_TREE_LINK( h, fd, TREE_BK, r );
+    PUT_TREE_LINK( h, r, TREE_FD, fd );
+  }else if( ( r = TREE_LINK( h, p, TREE_CHILD( 1 ) ) ) != NULL
+	    || ( r = TREE_LINK( h, p, TREE_CHILD( 0 ) ) ) != NULL ){
+    char *rp = p, *c;
+    int b = TREE_LINK( h, p, TREE_CHILD( 1 ) ) != NULL;
+
+    while( ( c = TREE_LINK( h, r, TREE_CHILD( 1 ) ) ) != NULL || ( c = TREE_LINK( h, r, TREE_CHILD( 0 ) ) ) != NULL ){
+      b = TREE_LINK( h, r, TREE_CHILD( 1 ) ) != NULL;
+      rp = r;
+      r = c;
+    }
+    PUT_TREE_LINK( h, rp, TREE_CHILD( b ), 0 );
+  }
+
+  if( parent == NULL && GET_LINK( h, SEG_LIST_HEAD( h, class ) ) != p )
+    return;	//chained block, not a node
+
+  if( parent == NULL ){
+    PUT_LINK( h, SEG_LIST_HEAD( h, class ), r );
+    if( r == NULL )
+      class_unmark( h, class );
+  }else
+    PUT_TREE_LINK( h, parent, TREE_CHILD( TREE_LINK( h, parent, TREE_CHILD( 1 ) ) == p ), r );
+
+  if( r != NULL ){
+    int b;
+
+    PUT_TREE_LINK( h, r, TREE_PARENT, parent );
+    for( b = 0; b < 2; b++ ){
+      char *c = TREE_LINK( h, p, TREE_CHILD( b ) );
+
+      PUT_TREE_LINK( h, r, TREE_CHILD( b ), c );
+      if( c != NULL )
+        PUT_TREE_LINK( h, c, TREE_PARENT, r );
+    }
+  }
+}
+
+#if !MM_TLSF
+/*
+ * tree_fit - find the smallest block of at least size in the size tree of
+ * class. in the class of size, the path of size's key is followed down,
+ * keeping the best fit among its nodes and the last right subtree it
+ * passes by: that subtree holds the next larger sizes, so failing an
+ * exact fit the smallest node in it, found by going left wherever
+ * possible, is the best fit below it. in a higher class every block fits
+ * and the smallest node of the whole tree is the best fit; in a lower
+ * class none does.
+ *
+ * size_t size: desired block size.
+ *
+ * returns: NULL if no block fits, otherwise ptr to a block of the best
+ * fit size, chained rather than the node if there is one.
+ */
+static void *tree_fit( struct mm_heap *h, int class, size_t size )
+{
+  char *t = GET_LINK( h, SEG_LIST_HEAD( h, class ) ), *best = NULL, *rst = NULL;
+  unsigned int key = tree_key( class, size );
+  size_t rem = (size_t)-1;
+  int depth;
+
+  if( get_size_class( size ) > class )
+    return NULL;
+  if( get_size_class( size ) < class ){
+    rst = t;
+    t = NULL;
+  }
+
+  for( depth = 0; t != NULL; depth++ ){
+    size_t tsize = GET_SIZE( GET_HEADER( t ) );
+    char *right = TREE_LINK( h, t, TREE_CHILD( 1 ) );
+
+    STAT( h, fit_probes, 1 );
+    if( tsize >= size && tsize - size < rem ){
+      best = t;
+      if( ( rem = tsize - size ) == 0 )
+        return TREE_LINK( h, best, TREE_FD );
+    }
+    t = TREE_LINK( h, t, TREE_CHILD( TREE_BIT( key, depth ) ) );
+    if( right != NULL && right != t )
+      rst = right;
+  }
+
+  for( t = rst; t != NULL; ){
+    size_t tsize = GET_SIZE( GET_HEADER( t ) );
+
+    STAT( h, fit_probes, 1 );
+    if( tsize - size < rem ){
+      best = t;
+      rem = tsize - size;
+    }
+    if( ( rst = TREE_LINK( h, t, TREE_CHILD( 0 ) ) ) == NULL )
+      rst = TREE_LINK( h, t, TREE_CHILD( 1 ) );
+    t = rst;
+  }
+
+  return best == NULL ? NULL : TREE_LINK( h, best, TREE_FD );
+}
+
+#endif
+
+/*
+ * tree_stats - count the blocks of a size tree under node t in the free
+ * blocks per class of s.
+ */
+static void tree_stats( struct mm_heap *h, void *t, struct mm_stats *s )
+{
+  if( t == NULL )
+    return;
+
+  void *j = t;
+  do{
+    int i = get_size_class( GET_SIZE( GET_HEADER( j ) ) );
+
+    s->free_blocks[i]++;
+    s->free_bytes[i] += GET_SIZE( GET_HEADER( j ) );
+  }while( ( j = TREE_LINK( h, j, TREE_FD ) ) != t );
+
+  tree_stats( h, TREE_LINK( h, t, TREE_CHILD( 0 ) ), s );
+  tree_stats( h, TREE_LINK( h, t, TREE_CHILD( 1 ) ), s );
+}
+
+/*
+ * heap_check - walk every block from mem_hp to mem_bp, checking each
+ * (see check_block), that no two free blocks are adjacent and that each
+ * header's PREV_ALLOC bit, the epilogue's included, is right, then
+ * walk every seg_lists list: each holds only free blocks of its class,
+ * its prev links mirror its next links, seg_bitmap marks it non empty
+ * exactly when it is (with TLSF, the first level marks each non zero
+ * second level word), and the lists together hold each free block of
+ * the walk exactly once, with the size trees (see check_tree). the quick
+ * lists hold quick_bytes of alloc'd blocks, each of its list's size.
+ * alloc'd blocks that are slab runs are checked with check_run and each
+ * class list must hold runs of its class with free objects only. every
+ * page of the heap must be h's in the page map, as a run page exactly
+ * for the runs. mmapped blocks are checked last.
+ *
+ * returns: 0 if the heap is consistent, -1 otherwise
+ */
+static int heap_check( struct mm_heap *h )
+{
+  char *p;
+  size_t free_blocks = 0, listed = 0, runs = 0;
+  int prev_free = 0;
+
+  if( GET( GET_HEADER( h->mem_hp ) ) != PACK( MIN_BLOCK_SIZE, PREV_ALLOC | 1 ) )
+    return check_fail( "bad prologue block", h->mem_hp );
+
+  for( p = GET_NEXT( h->mem_hp ); GET_SIZE( GET_HEADER( p ) ) != 0; p = GET_NEXT( p ) ){
+    if( check_block( h, p ) < 0 )
+      return -1;
+    if( ( GET_PREV_ALLOC( GET_HEADER( p ) ) == 0 ) != prev_free )
+      return check_fail( "PREV_ALLOC disagrees with previous block", p );
+
+    if( GET_ALLOC( GET_HEADER( p ) ) ){
+      if( is_run( p ) ){
+        if( check_run( h, (struct slab_run*)p ) < 0 )
+          return -1;
+        runs++;
+      }
+      prev_free = 0;
+      continue;
+    }
+    if( prev_free )
+      return check_fail( "adjacent free blocks", p );
+    prev_free = 1;
+    free_blocks++;
+  }
+
+  if( GET_HEADER( p ) != h->mem_bp + 1 - WSIZE || !GET_ALLOC( GET_HEADER( p ) ) )
+    return check_fail( "bad epilogue header", p );
+  if( ( GET_PREV_ALLOC( GET_HEADER( p ) ) == 0 ) != prev_free )
+    return check_fail( "PREV_ALLOC disagrees with previous block", p );
+
+  int i;
+  for( i = 0; i < SEG_LIST_COUNT; i++ ){
+    void *j, *prev = NULL;
+    void *head = GET_LINK( h, SEG_LIST_HEAD( h, i ) );
+
+    if( ( head != NULL ) != class_marked( h, i ) )
+      return check_fail( "seg_bitmap disagrees with seg_lists", head );
+    if( i >= SEG_TREE_CLASS ){
+      if( check_tree( h, head, NULL, i, 0, 0, &listed, free_blocks ) < 0 )
+        return -1;
+      continue;
+    }
+
+    for( j = head; j != NULL; prev = j, j = GET_NEXT_FREE( h, j ) ){
+      if( !INSIDE_HEAP( h, j ) || (unsigned long)j % ALIGNMENT )
+        return check_fail( "free list link outside heap", j );
+      if( GET_ALLOC( GET_HEADER( j ) ) )
+        return check_fail( "alloc'd block on a free list", j );
+      if( get_size_class( GET_SIZE( GET_HEADER( j ) ) ) != i )
+        return check_fail( "free block on the list of another class", j );
+      if( GET_PREV_FREE( h, j ) != prev )
+        return check_fail( "free list prev link does not match next link", j );
+      if( ++listed > free_blocks )
+        return check_fail( "free lists hold a block twice", j );
+    }
+  }
+
+  if( listed != free_blocks )
+    return check_fail( "free block missing from seg_lists", NULL );
+#if MM_QUICK
+  size_t quick_bytes = 0;
+  for( i = 0; i < QUICK_LISTS; i++ )
+    for( p = h->quick[i]; p != NULL; p = QUICK_NEXT( p ) ){
+      if( !INSIDE_HEAP( h, p ) || (unsigned long)p % ALIGNMENT )
+        return check_fail( "quick list link outside heap", p );
+      if( !GET_ALLOC( GET_HEADER( p ) ) )
+        return check_fail( "free block on a quick list", p );
+      if( GET_SIZE( GET_HEADER( p ) ) != MIN_BLOCK_SIZE + i * ALIGNMENT )
+        return check_fail( "block on the quick list of another size", p );
+      if( ( quick_bytes += GET_SIZE( GET_HEADER( p ) ) ) > h->quick_bytes )
+        return check_fail( "quick lists hold more bytes than counted", p );
+    }
+  if( quick_bytes != h->quick_bytes )
+    return check_fail( "quick lists hold fewer bytes than counted", NULL );
+#endif
+#if MM_TLSF
+  for( i = 0; i < SEG_FL_COUNT; i++ )
+    if( ( h->sl_bitmap[i] != 0 ) != ( h->fl_bitmap >> i & 1 ) )
+      return check_fail( "first level bitmap disagrees with second level", NULL );
+#endif
+
+  for( p = mem_region_heap_lo( h->region ); p <= h->mem_bp; p += RUN_SIZE ){
+    unsigned long e = pagemap_get( p );
+
+    if( PAGE_OWNER( e ) != h || ( PAGE_KIND( e ) != PAGE_BLOCKS && PAGE_KIND( e ) != PAGE_RUN ) )
+      return check_fail( "heap page not the heap's in the page map", p );
+    if( PAGE_KIND( e ) == PAGE_RUN && runs-- == 0 )
+      return check_fail( "page map marks pages that are not runs", p );
+  }
+  if( runs != 0 )
+    return check_fail( "run missing from the page map", NULL );
+
+  for( i = 0; i < SLAB_CLASSES; i++ ){
+    struct slab_run *run, *prev = NULL;
+
+    for( run = h->runs[i]; run != NULL; prev = run, run = run->next ){
+      if( !is_run( run ) || run->size != ( i + 1 ) * ALIGNMENT )
+        return check_fail( "run on the list of another class", run );
+      if( run->used == run->count )
+        return check_fail( "full run on a class list", run );
+      if( run->prev != prev )
+        return check_fail( "run list prev link does not match next link", run );
+    }
+  }
+
+  struct mmap_chunk *c;
+  size_t mapped = 0;
+  for( c = h->mmaps; c != NULL; c = c->next ){
+    if( check_mmapped( h, MMAP_PAYLOAD( c ) ) < 0 )
+      return -1;
+    mapped += c->len;
+  }
+  if( mapped != h->mmapped )
+    return check_fail( "mmapped bytes disagree with mappings", NULL );
+
+  return 0;
+}
+
+/*
+ * heap_check_last - check only what the last call changed: the block it
+ * returned and the free block it made or grew (see last and last_freed),
+ * with the blocks either side of them, and the epilogue. the previous
+ * block can only be reached, and is only checked, when it is free. each
+ * free block among them must be linked on the list of its class.
+ *
+ * returns: 0 if the blocks are consistent, -1 otherwise
+ */
+static int heap_check_last( struct mm_heap *h )
+{
+  void *touched[2] = { h->last, h->last_freed };
+  int i;
+
+  for( i = 0; i < 2; i++ ){
+    char *p = touched[i];
+
+    if( p == NULL )
+      continue;
+    if( i == 0 && GET_MMAPPED( GET_HEADER( p ) ) ){
+      if( check_mmapped( h, p ) < 0 )
+        return -1;
+      continue;
+    }
+    if( !INSIDE_HEAP( h, p ) ){
+      if( i == 1 )
+        continue;	//trimmed away
+      return check_fail( "block outside heap", p );
+    }
+
+    char *prev = GET_PREV_ALLOC( GET_HEADER( p ) ) ? NULL : GET_PREV( p ), *next = GET_NEXT( p );
+    if( check_block( h, p ) < 0 )
+      return -1;
+    if( i == 0 && is_run( p ) && check_run( h, (struct slab_run*)p ) < 0 )
+      return -1;
+    if( prev != NULL && !INSIDE_HEAP( h, prev ) )
+      return check_fail( "free previous block outside heap", p );
+    if( prev != NULL && ( check_block( h, prev ) < 0 || check_listed( h, prev ) < 0 ) )
+      return -1;
+    if( GET_SIZE( GET_HEADER( next ) ) != 0 && ( check_block( h, next ) < 0 || check_listed( h, next ) < 0 ) )
+      return -1;
+    if( check_listed( h, p ) < 0 )
+      return -1;
+
+    if( !GET_PREV_ALLOC( GET_HEADER( next ) ) != !GET_ALLOC( GET_HEADER( p ) ) )
+      return check_fail( "PREV_ALLOC disagrees with previous block", next );
+    if( !GET_ALLOC( GET_HEADER( p ) ) && ( prev != NULL || !GET_ALLOC( GET_HEADER( next ) ) ) )
+      return check_fail( "adjacent free blocks", p );
+    if( i == 0 && !GET_ALLOC( GET_HEADER( p ) ) )
+      return check_fail( "returned block is not alloc'd", p );
+  }
+
+  if( GET_SIZE( h->mem_bp + 1 - WSIZE ) != 0 || !GET_ALLOC( h->mem_bp + 1 - WSIZE ) )
+    return check_fail( "bad epilogue header", h->mem_bp + 1 );
+
+  return 0;
+}
+
+/*
+ * check_block - check heap block p: aligned payload, a size that is a
+ * multiple of ALIGNMENT and at least MIN_BLOCK_SIZE, ends inside the heap,
+ * a footer matching the header if free and no MMAP_BIT.
+ *
+ * returns: 0 if the block is consistent, -1 otherwise
+ */
+static int check_block( struct mm_heap *h, void *p )
+{
+  size_t size = GET_SIZE( GET_HEADER( p ) );
+
+  if( (unsigned long)p % ALIGNMENT )
+    return check_fail( "payload not aligned", p );
+  if( size < MIN_BLOCK_SIZE || size % ALIGNMENT )
+    return check_fail( "bad block size", p );
+  if( (char*)p + size > h->mem_bp + 1 )
+    return check_fail( "block runs past end of heap", p );
+  if( !GET_ALLOC( GET_HEADER( p ) ) && GET( GET_FOOTER( p ) ) != PACK( size, 0 ) )
+    return check_fail( "header does not match footer", p );
+  if( GET_MMAPPED( GET_HEADER( p ) ) )
+    return check_fail( "heap block marked mmapped", p );
+  return 0;
+}
+
+/*
+ * check_listed - check that heap block p, if free, is linked on the list
+ * of its class: its neighbours in the list point back at it and
+ * seg_bitmap marks the list non empty. in classes with a size tree, its
+ * neighbours in its chain must point back at it, and so must its parent
+ * if it is a node.
+ *
+ * returns: 0 if the block is consistent, -1 otherwise
+ */
+static int check_listed( struct mm_heap *h, void *p )
+{
+  if( GET_ALLOC( GET_HEADER( p ) ) )
+    return 0;
+
+  int class = get_size_class( GET_SIZE( GET_HEADER( p ) ) );
+  void *next = GET_NEXT_FREE( h, p );
+  void *prev = GET_PREV_FREE( h, p );
+
+  if( !class_marked( h, class ) )
+    return check_fail( "seg_bitmap misses the class of a free block", p );
+  if( class >= SEG_TREE_CLASS ){
+    char *parent = TREE_LINK( h, p, TREE_PARENT );
+
+    if( !INSIDE_HEAP( h, next ) || !INSIDE_HEAP( h, prev )
+	|| TREE_LINK( h, next, TREE_BK ) != p || TREE_LINK( h, prev, TREE_FD ) != p )
+      return check_fail( "free block not linked in its size tree chain", p );
+    if( parent != NULL && ( !INSIDE_HEAP( h, parent ) || ( TREE_LINK( h, parent, TREE_CHILD( 0 ) ) != p
+							    && TREE_LINK( h, parent, TREE_CHILD( 1 ) ) != p ) ) )
+      return check_fail( "size tree node not linked from its parent", p );
+    return 0;
+  }
+  if( prev == NULL ? GET_LINK( h, SEG_LIST_HEAD( h, class ) ) != p
+      : !INSIDE_HEAP( h, prev ) || GET_NEXT_FREE( h, prev ) != p )
+    return check_fail( "free block not linked from its class list", p );
+  if( next != NULL && ( !INSIDE_HEAP( h, next ) || GET_PREV_FREE( h, next ) != p ) )
+    return check_fail( "free block not linked to its list successor", p );
+  return 0;
+}
+
+/*
+ * check_tree - check the size tree of class under node t, at depth with
+ * key prefix: each block is a free block of the class inside the heap, a
+ * node's parent link and key bits match its place, and a node's chain
+ * holds blocks of its size whose links mirror each other. listed counts
+ * the blocks, which must not pass the free_blocks of the walk.
+ *
+ * returns: 0 if the tree is consistent, -1 otherwise
+ */
+static int check_tree( struct mm_heap *h, void *t, void *parent, int class, unsigned int prefix,
+		       int depth, size_t *listed, size_t free_blocks )
+{
+  if( t == NULL )
+    return 0;
+
+  size_t size = GET_SIZE( GET_HEADER( t ) );
+  void *j = t;
+  int b;
+
+  if( !INSIDE_HEAP( h, t ) || (unsigned long)t % ALIGNMENT )
+    return check_fail( "size tree link outside heap", t );
+  if( TREE_LINK( h, t, TREE_PARENT ) != parent )
+    return check_fail( "size tree parent link does not match child link", t );
+  if( get_size_class( size ) != class )
+    return check_fail( "free block in the size tree of another class", t );
+  if( depth > 0 && tree_key( class, size ) >> ( 32 - depth ) != prefix )
+    return check_fail( "size tree node off the path of its key", t );
+
+  do{
+    if( !INSIDE_HEAP( h, j ) || (unsigned long)j % ALIGNMENT )
+      return check_fail( "size tree link outside heap", j );
+    if( GET_ALLOC( GET_HEADER( j ) ) )
+      return check_fail( "alloc'd block in a size tree", j );
+    if( GET_SIZE( GET_HEADER( j ) ) != size )
+      return check_fail( "size tree chain holds another size", j );
+    if( j != t && TREE_LINK( h, j, TREE_PARENT ) != NULL )
+      return check_fail( "chained block has a parent link", j );
+    if( !INSIDE_HEAP( h, TREE_LINK( h, j, TREE_FD ) ) || TREE_LINK( h, TREE_LINK( h, j, TREE_FD ), TREE_BK ) != j )
+      return check_fail( "size tree chain links do not match", j );
+    if( ++*listed > free_blocks )
+      return check_fail( "free lists hold a block twice", j );
+  }while( ( j = TREE_LINK( h, j, TREE_FD ) ) != t );
+
+  for( b = 0; b < 2; b++ )
+    if( check_tree( h, TREE_LINK( h, t, TREE_CHILD( b ) ), t, class, prefix << 1 | b, depth + 1,
+		    listed, free_blocks ) < 0 )
+      return -1;
+  return 0;
+}
+
+/*
+ * check_mmapped - check mmapped block p: its header, the length of its
+ * mapping, its page map entry and its links on the mmaps list.
+ *
+ * returns: 0 if the block is consistent, -1 otherwise
+ */
+static int check_mmapped( struct mm_heap *h, void *p )
+{
+  struct mmap_chunk *c = MMAP_CHUNK( p );
+
+  if( GET( GET_HEADER( p ) ) != PACK( 0, MMAP_BIT | 1 ) )
+    return check_fail( "bad mmapped block header", p );
+  if( c->len % mem_pagesize() || c->len <= MMAP_HEADER_SIZE )
+    return check_fail( "bad mapping length", p );
+  if( pagemap_get( p ) != PAGE_ENTRY( h, PAGE_MMAP ) || c->heap != h )
+    return check_fail( "mmapped block not the heap's in the page map", p );
+  if( c->prev == NULL ? h->mmaps != c : c->prev->next != c )
+    return check_fail( "mmapped block not linked from mmaps list", p );
+  if( c->next != NULL && c->next->prev != c )
+    return check_fail( "mmapped block not linked to its list successor", p );
+  return 0;
+}
+
+/*
+ * check_run - check slab run: a heap block of RUN_SIZE (plus a remainder
+ * too small to split off) with its payload on a RUN_SIZE boundary, an
+ * object size of a slab class with the matching object count, counts
+ * in order and a free list of carved - used distinct objects of the run.
+ *
+ * returns: 0 if the run is consistent, -1 otherwise
+ */
+static int check_run( struct mm_heap *h, struct slab_run *run )
+{
+  char *objects = (char*)run + RUN_HEADER_SIZE;
+  unsigned int n = 0;
+  void *p;
+
+  if( GET_SIZE( GET_HEADER( run ) ) - RUN_SIZE >= MIN_BLOCK_SIZE || (unsigned long)run % RUN_SIZE )
+    return check_fail( "bad run block", run );
+  if( run->size == 0 || run->size > SLAB_MAX || run->size % ALIGNMENT ||
+      run->count != ( RUN_SIZE - RUN_HEADER_SIZE - WSIZE ) / run->size )
+    return check_fail( "bad run object size", run );
+  if( run->used > run->carved || run->carved > run->count )
+    return check_fail( "bad run object counts", run );
+
+  for( p = run->free; p != NULL; p = SLAB_NEXT( p ) ){
+    if( (char*)p < objects || RUN_OF( p ) != run || ( (char*)p - objects ) % run->size ||
+        ( (char*)p - objects ) / run->size >= run->carved )
+      return check_fail( "run free list link outside run", p );
+    if( ++n > run->carved - run->used )
+      return check_fail( "run free list holds too many objects", p );
+  }
+  if( n != run->carved - run->used )
+    return check_fail( "free object missing from run free list", run );
+  return 0;
+}
 
-
+/*
+ * check_fail - report a consistency problem at p on stderr
+ *
+ * returns: -1
+ */
+static int check_fail( const char *msg, void *p )
+{
+  fprintf( stderr, "mm_check: %s at %p\n", msg, p );
+  return -1;
+}
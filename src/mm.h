@@ -1,6 +1,83 @@
 #include <stdio.h>
 
+/* paths taken by mm_realloc, see struct mm_stats */
+enum mm_realloc_path {
+  MM_REALLOC_FITS,	/* block already big enough */
+  MM_REALLOC_SHRINK,	/* tail split off and freed */
+  MM_REALLOC_ABSORB,	/* grown into free next block */
+  MM_REALLOC_EXTEND,	/* last block, heap extended */
+  MM_REALLOC_REMAP,	/* mmapped block, mremap'd */
+  MM_REALLOC_MOVE,	/* new block alloc'd and copied */
+  MM_REALLOC_PATHS
+};
+
+/* size of the per-class arrays of struct mm_stats */
+#define MM_STATS_CLASSES 512
+
+/*
+ * allocator statistics, see mm_stats. mallocs and frees include those a
+ * moving realloc makes. every counter is 0 in a build without MM_STATS;
+ * the sizes and free lists are always filled in. the heap counts blocks
+ * held by thread caches or on quick lists as alloc'd, and only sees the
+ * calls that reach it.
+ */
+struct mm_stats {
+  int counted;			/* counters kept, MM_STATS build */
+  unsigned long mallocs;	/* blocks alloc'd */
+  unsigned long frees;		/* blocks freed */
+  unsigned long remote_frees;	/* of those, freed through the remote queue */
+  unsigned long reallocs;	/* reallocs of a block */
+  unsigned long realloc_paths[MM_REALLOC_PATHS]; /* all but MOVE are in place */
+  unsigned long splits;		/* blocks split, remainder freed */
+  unsigned long coalesce_prev;	/* frees merged with previous block only */
+  unsigned long coalesce_next;	/* frees merged with next block only */
+  unsigned long coalesce_both;	/* frees merged with both neighbours */
+  unsigned long sbrk_calls;	/* heap extensions */
+  size_t sbrk_bytes;		/* bytes they added */
+  unsigned long trims;		/* heap trims */
+  size_t trim_bytes;		/* bytes they released */
+  unsigned long mmaps;		/* blocks mmapped */
+  unsigned long slab_runs;	/* slab runs in use */
+  unsigned long fit_searches;	/* free list searches */
+  unsigned long fit_probes;	/* free blocks they visited */
+  unsigned long quick_hits;	/* mallocs served from quick lists */
+  unsigned long consolidations;	/* quick lists merged back in bulk */
+  size_t live_bytes;		/* payload bytes alloc'd */
+  size_t peak_bytes;		/* highest live_bytes */
+  size_t heap_bytes;		/* heap size */
+  size_t mmapped_bytes;		/* bytes in mappings of mmapped blocks */
+  int classes;			/* seg_lists classes */
+  size_t class_min[MM_STATS_CLASSES];	/* smallest block size per class */
+  unsigned long free_blocks[MM_STATS_CLASSES];	/* free blocks per class */
+  size_t free_bytes[MM_STATS_CLASSES];		/* free bytes per class */
+};
+
+/* arenas shared by all threads, safe to call from any thread; mm_init is not */
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern size_t mm_usable_size(void *ptr);
+extern int mm_trim(size_t pad);
+extern void mm_set_mmap_threshold(size_t threshold);
+extern int mm_check(void);
+extern int mm_check_last(void);
+extern void mm_stats(struct mm_stats *s);
+extern void mm_stats_print(FILE *out, const struct mm_stats *s);
+extern void mm_stats_print_json(FILE *out, const struct mm_stats *s);
+extern size_t mm_mmapped(void);
+
+/* independent heaps, each over an address range of its own and with a lock */
+typedef struct mm_heap mm_heap_t;
+
+extern mm_heap_t *mm_heap_create(size_t max_heap);
+extern void mm_heap_destroy(mm_heap_t *h);
+extern void *mm_heap_malloc(mm_heap_t *h, size_t size);
+extern void mm_heap_free(mm_heap_t *h, void *ptr);
+extern void *mm_heap_realloc(mm_heap_t *h, void *ptr, size_t size);
+extern int mm_heap_trim(mm_heap_t *h, size_t pad);
+extern void mm_heap_set_mmap_threshold(mm_heap_t *h, size_t threshold);
+extern int mm_heap_check(mm_heap_t *h);
+extern int mm_heap_check_last(mm_heap_t *h);
+extern void mm_heap_stats(mm_heap_t *h, struct mm_stats *s);
+extern size_t mm_heap_mmapped(mm_heap_t *h);
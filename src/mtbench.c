@@ -0,0 +1,584 @@
+/*
+ * mtbench.c - multi-threaded malloc scaling benchmark
+ *
+ * Runs the same small-block workload on 1, 2, 4, .. 64 threads at once
+ * against mm.c and reports the throughput of each thread count, so that
+ * the cost of sharing the heap between threads shows as the drop from
+ * linear scaling. With -l the libc malloc package runs the same workload
+ * as a baseline.
+ *
+ * Each thread owns a table of slots. An op picks a random slot, frees
+ * the block in it and allocs a new block of random size in its place,
+ * writing to the first and last bytes of the block. With -x a share of
+ * the freed blocks are swapped through a pool shared by all threads
+ * first, so that they are freed by a thread other than the one that
+ * alloc'd them. Every thread draws from its own seeded generator, so a
+ * run only depends on the options.
+ *
+ * With -p the threads form producer/consumer pairs instead: the producer
+ * allocs blocks and passes them through a ring to its consumer, which
+ * frees them, so that every free is a cross-thread free.
+ *
+ * With -u each thread fills its slots before the clock starts and then
+ * looks up the usable size of a random slot num_ops times, which times
+ * the pointer to block metadata lookup of mm_usable_size (and
+ * malloc_usable_size with -l) on its own. Large -s tables make the
+ * lookups miss the caches.
+ *
+ * With -c no timing is done: instead each thread allocs its slots from
+ * one heap of mm_heap_create and frees them with mm_free, num_ops times
+ * over, and the run fails unless every block is back in that heap (its
+ * live bytes are 0 and it passes mm_heap_check) once the threads are done.
+ *
+ * Build mtbench-lock (MM_TCACHE=0, MM_ARENAS=1) to compare against a
+ * single locked heap, with no arenas and no thread caches.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <malloc.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define MAXTHREADS      64  /* most threads of a run */
+#define MAXRUNS         16  /* most thread counts of -t */
+#define POOLSIZE      1024  /* slots of the shared pool of -x */
+#define RINGSIZE      1024  /* slots of the ring of a -p pair */
+
+/******************************
+ * The key compound data types
+ *****************************/
+
+/* An allocator under test */
+typedef struct {
+    char *name;
+    void *(*malloc)(size_t size);
+    void (*free)(void *p);
+    size_t (*usable)(void *p);
+} alloc_t;
+
+/* The ring of a producer/consumer pair, indexes on lines of their own */
+typedef struct {
+    void *slot[RINGSIZE];
+    unsigned long head;   /* slots filled by the producer */
+    char pad1[64];
+    unsigned long tail;   /* slots emptied by the consumer */
+    char pad2[64];
+} ring_t;
+
+/* One thread of a run */
+typedef struct {
+    pthread_t tid;
+    int id;
+    alloc_t *alloc;
+    ring_t *ring;         /* ring of its pair, with -p */
+} worker_t;
+
+/********************
+ * Global variables
+ *******************/
+
+static long num_ops = 1000000;         /* ops per thread */
+static int num_slots = 256;            /* slots per thread */
+static size_t max_size = 256;          /* sizes are drawn from 1..max_size */
+static int remote_pct = 0;             /* percent of frees through the pool */
+static int pipeline = 0;               /* producer/consumer pairs */
+static int lookup = 0;                 /* usable size lookups */
+static int check = 0;                  /* heap free check of -c */
+static unsigned long long seed = 1;
+
+static void *pool[POOLSIZE];           /* blocks in transit between threads */
+static pthread_barrier_t start;        /* lines the threads of a run up */
+static pthread_barrier_t done;         /* ends the timed part of -u */
+static mm_heap_t *check_heap;          /* heap of the -c check */
+
+/*********************
+ * Function prototypes
+ *********************/
+
+static double run(alloc_t *alloc, int threads);
+static void *work(void *arg);
+static void *produce(void *arg);
+static void *consume(void *arg);
+static void *look_up(void *arg);
+static int check_heap_free(int threads);
+static void *heap_free_work(void *arg);
+static unsigned long long rng_next(unsigned long long *state);
+static double now(void);
+
+static void usage(void);
+static void app_error(char *msg);
+static void unix_error(char *msg);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int c, i;
+    int runs[MAXRUNS] = {1, 2, 4, 8, 16, 32, 64};
+    int num_runs = 7;
+    int runs_given = 0;
+    int libc = 0;
+    char *p;
+    alloc_t mm_alloc = {"mm", mm_malloc, mm_free, mm_usable_size};
+    alloc_t libc_alloc = {"libc", malloc, free, malloc_usable_size};
+
+    while ((c = getopt(argc, argv, "t:n:s:m:x:r:pulch")) != EOF) {
+	switch (c) {
+	case 't': /* Thread counts */
+	    runs_given = 1;
+	    num_runs = 0;
+	    for (p = optarg; *p && num_runs < MAXRUNS; p += strcspn(p, ","), p += *p == ',')
+		runs[num_runs++] = atoi(p);
+	    break;
+	case 'n': /* Ops per thread */
+	    num_ops = atol(optarg);
+	    break;
+	case 's': /* Slots per thread */
+	    num_slots = atoi(optarg);
+	    break;
+	case 'm': /* Largest request size */
+	    max_size = strtoul(optarg, NULL, 0);
+	    break;
+	case 'x': /* Cross-thread frees */
+	    remote_pct = atoi(optarg);
+	    break;
+	case 'r': /* Seed */
+	    seed = strtoull(optarg, NULL, 0);
+	    break;
+	case 'p': /* Producer/consumer pairs */
+	    pipeline = 1;
+	    break;
+	case 'u': /* Usable size lookups */
+	    lookup = 1;
+	    break;
+	case 'l': /* Also run libc */
+	    libc = 1;
+	    break;
+	case 'c': /* Check that mm_free returns heap blocks */
+	    check = 1;
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+
+    if (num_runs == 0 || num_ops < 1 || num_slots < 1 || max_size < 1)
+	app_error("-t, -n, -s and -m must be positive");
+    if (pipeline && lookup)
+	app_error("-p and -u are exclusive");
+    if (pipeline && !runs_given) {
+	/* pairs need two threads */
+	for (i = 1; i < num_runs; i++)
+	    runs[i - 1] = runs[i];
+	num_runs--;
+    }
+    for (i = 0; i < num_runs; i++) {
+	if (runs[i] < 1 || runs[i] > MAXTHREADS)
+	    app_error("Thread counts must be in 1..64");
+	if (pipeline && runs[i] % 2)
+	    app_error("Thread counts must be even with -p");
+    }
+
+    mem_init();
+
+    if (check) {
+	int failed = 0;
+	for (i = 0; i < num_runs; i++)
+	    failed |= check_heap_free(runs[i]);
+	mem_deinit();
+	exit(failed);
+    }
+
+    if (pipeline)
+	printf("%ld ops per thread, producer/consumer pairs, sizes 1..%zu\n",
+	       num_ops, max_size);
+    else if (lookup)
+	printf("%ld usable size lookups per thread, %d slots, sizes 1..%zu\n",
+	       num_ops, num_slots, max_size);
+    else
+	printf("%ld ops per thread, %d slots, sizes 1..%zu, %d%% remote frees\n",
+	       num_ops, num_slots, max_size, remote_pct);
+    printf("%8s%12s%12s%10s", "threads", "mm Mops/s", "per thread", "scaling");
+    if (lookup)
+	printf("%10s", "ns/op");
+    if (libc)
+	printf("%12s%10s", "libc Mops/s", "mm/libc");
+    if (libc && lookup)
+	printf("%12s", "libc ns/op");
+    printf("\n");
+
+    double base = 0;
+    for (i = 0; i < num_runs; i++) {
+	if (mm_init() < 0)
+	    app_error("mm_init failed");
+	double mops = run(&mm_alloc, runs[i]);
+	if (i == 0)
+	    base = mops / runs[0];
+	printf("%8d%12.2f%12.2f%10.2f", runs[i], mops, mops / runs[i],
+	       mops / (base * runs[i]));
+	if (lookup)
+	    printf("%10.2f", 1e3 * runs[i] / mops);
+	if (libc) {
+	    double libc_mops = run(&libc_alloc, runs[i]);
+	    printf("%12.2f%10.2f", libc_mops, mops / libc_mops);
+	    if (lookup)
+		printf("%12.2f", 1e3 * runs[i] / libc_mops);
+	}
+	printf("\n");
+	fflush(stdout);
+    }
+
+    mem_deinit();
+    exit(0);
+}
+
+/*
+ * run - run the workload on threads threads against alloc. blocks still
+ *     in the pool afterwards are freed by the main thread. with -u the
+ *     clock stops once every thread is done with its lookups, before the
+ *     threads free their slots.
+ *
+ *     returns: throughput in millions of ops per second
+ */
+static double run(alloc_t *alloc, int threads)
+{
+    worker_t workers[MAXTHREADS];
+    ring_t *rings = NULL;
+    double secs;
+    int i;
+
+    memset(pool, 0, sizeof(pool));
+    if (pipeline && (rings = calloc(threads / 2, sizeof(ring_t))) == NULL)
+	unix_error("calloc failed in run");
+    if (pthread_barrier_init(&start, NULL, threads + 1) != 0 ||
+	pthread_barrier_init(&done, NULL, threads + 1) != 0)
+	app_error("pthread_barrier_init failed");
+
+    for (i = 0; i < threads; i++) {
+	workers[i].id = i;
+	workers[i].alloc = alloc;
+	workers[i].ring = pipeline ? &rings[i / 2] : NULL;
+	if ((errno = pthread_create(&workers[i].tid, NULL,
+				    lookup ? look_up : !pipeline ? work :
+				    i % 2 ? consume : produce,
+				    &workers[i])) != 0)
+	    unix_error("pthread_create failed");
+    }
+
+    /* the workers wait for this thread, so the clock starts first */
+    secs = now();
+    pthread_barrier_wait(&start);
+    if (lookup) {
+	pthread_barrier_wait(&done);
+	secs = now() - secs;
+    }
+    for (i = 0; i < threads; i++)
+	pthread_join(workers[i].tid, NULL);
+    if (!lookup)
+	secs = now() - secs;
+
+    pthread_barrier_destroy(&start);
+    pthread_barrier_destroy(&done);
+    for (i = 0; i < POOLSIZE; i++)
+	alloc->free(pool[i]);
+    free(rings);
+
+    return threads * num_ops / secs / 1e6;
+}
+
+/*
+ * work - body of one thread: num_ops slot replacements, then free
+ *     whatever the slots still hold
+ */
+static void *work(void *arg)
+{
+    worker_t *w = arg;
+    alloc_t *alloc = w->alloc;
+    unsigned long long rng = seed * MAXTHREADS + w->id;
+    void **slots;
+    long n;
+    int i;
+
+    if ((slots = calloc(num_slots, sizeof(void *))) == NULL)
+	unix_error("calloc failed in work");
+
+    pthread_barrier_wait(&start);
+
+    for (n = 0; n < num_ops; n++) {
+	unsigned long long r = rng_next(&rng);
+	void *p = slots[r % num_slots];
+
+	/* hand the old block to another thread, and free one of theirs */
+	if (p != NULL && remote_pct > 0 && (r >> 32) % 100 < remote_pct)
+	    p = __atomic_exchange_n(&pool[(r >> 16) % POOLSIZE], p, __ATOMIC_ACQ_REL);
+	alloc->free(p);
+
+	size_t size = 1 + (r >> 40) % max_size;
+	char *q = alloc->malloc(size);
+	if (q == NULL)
+	    app_error("malloc failed in work");
+	q[0] = q[size - 1] = (char)n;
+	slots[r % num_slots] = q;
+    }
+
+    for (i = 0; i < num_slots; i++)
+	alloc->free(slots[i]);
+    free(slots);
+    return NULL;
+}
+
+/*
+ * produce - body of the producer of a pair: alloc num_ops blocks and
+ *     pass them on through the ring, waiting while it is full
+ */
+static void *produce(void *arg)
+{
+    worker_t *w = arg;
+    ring_t *ring = w->ring;
+    unsigned long long rng = seed * MAXTHREADS + w->id;
+    unsigned long head = 0;
+    long n;
+
+    pthread_barrier_wait(&start);
+
+    for (n = 0; n < num_ops; n++) {
+	size_t size = 1 + (rng_next(&rng) >> 40) % max_size;
+	char *q = w->alloc->malloc(size);
+	if (q == NULL)
+	    app_error("malloc failed in produce");
+	q[0] = q[size - 1] = (char)n;
+
+	while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == RINGSIZE)
+	    sched_yield();
+	ring->slot[head % RINGSIZE] = q;
+	__atomic_store_n(&ring->head, ++head, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/*
+ * consume - body of the consumer of a pair: free the num_ops blocks
+ *     its producer passes on, waiting while the ring is empty
+ */
+static void *consume(void *arg)
+{
+    worker_t *w = arg;
+    ring_t *ring = w->ring;
+    unsigned long tail = 0;
+    long n;
+
+    pthread_barrier_wait(&start);
+
+    for (n = 0; n < num_ops; n++) {
+	while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
+	    sched_yield();
+	char *p = ring->slot[tail % RINGSIZE];
+	if (p[0] != (char)n)
+	    app_error("Block payload corrupted in consume");
+	w->alloc->free(p);
+	__atomic_store_n(&ring->tail, ++tail, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/*
+ * look_up - body of one thread of -u: fill the slots, then look up the
+ *     usable size of num_ops random slots, then free the slots
+ */
+static void *look_up(void *arg)
+{
+    worker_t *w = arg;
+    alloc_t *alloc = w->alloc;
+    unsigned long long rng = seed * MAXTHREADS + w->id;
+    size_t *sizes, sum = 0;
+    void **slots;
+    long n;
+    int i;
+
+    if ((slots = calloc(num_slots, sizeof(void *))) == NULL ||
+	(sizes = calloc(num_slots, sizeof(size_t))) == NULL)
+	unix_error("calloc failed in look_up");
+    for (i = 0; i < num_slots; i++) {
+	sizes[i] = 1 + (rng_next(&rng) >> 40) % max_size;
+	if ((slots[i] = alloc->malloc(sizes[i])) == NULL)
+	    app_error("malloc failed in look_up");
+    }
+
+    pthread_barrier_wait(&start);
+
+    for (n = 0; n < num_ops; n++)
+	sum += alloc->usable(slots[rng_next(&rng) % num_slots]);
+
+    pthread_barrier_wait(&done);
+
+    for (i = 0; i < num_slots; i++) {
+	if (alloc->usable(slots[i]) < sizes[i])
+	    app_error("Usable size below the request size in look_up");
+	alloc->free(slots[i]);
+    }
+    if (sum < (size_t)num_ops)
+	app_error("Usable size of 0 in look_up");
+    free(sizes);
+    free(slots);
+    return NULL;
+}
+
+/*
+ * check_heap_free - run heap_free_work on threads threads against one
+ *     heap of mm_heap_create, then check that the heap got every block
+ *     back through mm_free.
+ *
+ *     returns: 0 if it did, 1 otherwise
+ */
+static int check_heap_free(int threads)
+{
+    worker_t workers[MAXTHREADS];
+    struct mm_stats st;
+    int i, failed = 0;
+
+    if (mm_init() < 0)
+	app_error("mm_init failed");
+    if ((check_heap = mm_heap_create(64 << 20)) == NULL)
+	app_error("mm_heap_create failed");
+    if (pthread_barrier_init(&start, NULL, threads) != 0)
+	app_error("pthread_barrier_init failed");
+
+    for (i = 0; i < threads; i++) {
+	workers[i].id = i;
+	if ((errno = pthread_create(&workers[i].tid, NULL, heap_free_work,
+				    &workers[i])) != 0)
+	    unix_error("pthread_create failed in check_heap_free");
+    }
+    for (i = 0; i < threads; i++)
+	pthread_join(workers[i].tid, NULL);
+    pthread_barrier_destroy(&start);
+
+    mm_heap_stats(check_heap, &st);
+    if (mm_heap_check(check_heap) < 0)
+	failed = 1;
+    if (st.counted && (st.live_bytes != 0 || st.frees != st.mallocs)) {
+	printf("%d threads: %lu of %lu heap blocks not freed, %zu bytes live\n",
+	       threads, st.mallocs - st.frees, st.mallocs, st.live_bytes);
+	failed = 1;
+    }
+    printf("%d threads: mm_free of heap blocks %s%s\n", threads,
+	   failed ? "FAILED" : "ok", st.counted ? "" : " (no stats, checked heap only)");
+    mm_heap_destroy(check_heap);
+    return failed;
+}
+
+/*
+ * heap_free_work - body of one thread of -c: num_ops times, fill the
+ *     slots with blocks of check_heap, then free them all with mm_free.
+ *     the thread first allocs and frees through mm_malloc so that it has
+ *     an arena of its own.
+ */
+static void *heap_free_work(void *arg)
+{
+    worker_t *w = arg;
+    unsigned long long rng = seed * MAXTHREADS + w->id;
+    void **slots;
+    long n;
+    int i;
+
+    if ((slots = calloc(num_slots, sizeof(void *))) == NULL)
+	unix_error("calloc failed in heap_free_work");
+    mm_free(mm_malloc(1));
+
+    pthread_barrier_wait(&start);
+
+    for (n = 0; n < num_ops; n++) {
+	for (i = 0; i < num_slots; i++) {
+	    size_t size = 1 + (rng_next(&rng) >> 40) % max_size;
+	    if ((slots[i] = mm_heap_malloc(check_heap, size)) == NULL)
+		app_error("mm_heap_malloc failed in heap_free_work");
+	    ((char *)slots[i])[size - 1] = (char)n;
+	}
+	for (i = 0; i < num_slots; i++)
+	    mm_free(slots[i]);
+    }
+    free(slots);
+    return NULL;
+}
+
+/*
+ * rng_next - next value of a splitmix64 generator
+ */
+static unsigned long long rng_next(unsigned long long *state)
+{
+    unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * now - wall clock time in seconds
+ */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*************************************
+ * Some miscellaneous helper routines
+ ************************************/
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+/*
+ * unix_error - Report a Unix-style error
+ */
+static void unix_error(char *msg)
+{
+    fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mtbench [-chlpu] [-t <threads>] [-n <ops>] [-s <slots>] [-m <max size>]\n");
+    fprintf(stderr, "               [-x <pct>] [-r <seed>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-t <n1>,<n2>.. Thread counts to run (default 1,2,4,8,16,32,64).\n");
+    fprintf(stderr, "\t-n <ops>       Ops per thread (default 1000000).\n");
+    fprintf(stderr, "\t-s <slots>     Blocks live per thread (default 256).\n");
+    fprintf(stderr, "\t-m <max size>  Largest request size (default 256).\n");
+    fprintf(stderr, "\t-x <pct>       Pass pct%% of the freed blocks to other threads (default 0).\n");
+    fprintf(stderr, "\t-r <seed>      Seed of the random number generators (default 1).\n");
+    fprintf(stderr, "\t-p             Run producer/consumer pairs (default 2,4,..64 threads).\n");
+    fprintf(stderr, "\t-u             Time usable size lookups of the slots' blocks.\n");
+    fprintf(stderr, "\t-l             Also run the libc malloc package.\n");
+    fprintf(stderr, "\t-c             Check that mm_free gives blocks of mm_heap_create back.\n");
+    fprintf(stderr, "\t-h             Print this message.\n");
+}
@@ -0,0 +1,86 @@
+/*
+ * stats.c - printing of struct mm_stats, shared by the allocation engines
+ * (mm.c and buddy.c), which each fill the statistics in their own way. a
+ * figure an engine does not keep stays 0.
+ */
+
+#include <stdio.h>
+
+#include "mm.h"
+
+/*
+ * mm_stats_print - print statistics s to out as text, one figure per
+ * line, followed by the free blocks of each non empty free list class.
+ *
+ * FILE* out: stream to print to.
+ * struct mm_stats* s: statistics from mm_stats or mm_heap_stats.
+ *
+ */
+void mm_stats_print( FILE *out, const struct mm_stats *s )
+{
+  static const char *paths[MM_REALLOC_PATHS] = { "fits", "shrink", "absorb", "extend", "remap", "move" };
+  int i;
+
+  if( !s->counted )
+    fprintf( out, "counters        off (built without MM_STATS)\n" );
+  fprintf( out, "mallocs         %lu\n", s->mallocs );
+  fprintf( out, "frees           %lu (%lu remote)\n", s->frees, s->remote_frees );
+  fprintf( out, "reallocs        %lu (in place %lu, moved %lu)\n", s->reallocs,
+	   s->reallocs - s->realloc_paths[MM_REALLOC_MOVE], s->realloc_paths[MM_REALLOC_MOVE] );
+  for( i = 0; i < MM_REALLOC_PATHS; i++ )
+    fprintf( out, "  %-13s %lu\n", paths[i], s->realloc_paths[i] );
+  fprintf( out, "splits          %lu\n", s->splits );
+  fprintf( out, "coalesces       prev %lu, next %lu, both %lu\n",
+	   s->coalesce_prev, s->coalesce_next, s->coalesce_both );
+  fprintf( out, "sbrk            %lu calls, %zu bytes\n", s->sbrk_calls, s->sbrk_bytes );
+  fprintf( out, "trims           %lu calls, %zu bytes\n", s->trims, s->trim_bytes );
+  fprintf( out, "mmaps           %lu, %zu bytes mapped\n", s->mmaps, s->mmapped_bytes );
+  fprintf( out, "slab runs       %lu\n", s->slab_runs );
+  fprintf( out, "fit probes      %.2f per search (%lu searches)\n",
+	   s->fit_searches ? (double)s->fit_probes / s->fit_searches : 0.0, s->fit_searches );
+  fprintf( out, "quick lists     %lu hits, %lu consolidations\n", s->quick_hits, s->consolidations );
+  fprintf( out, "payload         %zu live, %zu peak\n", s->live_bytes, s->peak_bytes );
+  fprintf( out, "heap            %zu bytes\n", s->heap_bytes );
+  fprintf( out, "free lists      class  min size  blocks  bytes\n" );
+  for( i = 0; i < s->classes; i++ )
+    if( s->free_blocks[i] )
+      fprintf( out, "                %5d  %8zu  %6lu  %zu\n",
+	       i, s->class_min[i], s->free_blocks[i], s->free_bytes[i] );
+}
+
+/*
+ * mm_stats_print_json - print statistics s to out as one JSON object.
+ * free lists are an array of [class, min size, blocks, bytes] for each non
+ * empty free list class.
+ *
+ * FILE* out: stream to print to.
+ * struct mm_stats* s: statistics from mm_stats or mm_heap_stats.
+ *
+ */
+void mm_stats_print_json( FILE *out, const struct mm_stats *s )
+{
+  static const char *paths[MM_REALLOC_PATHS] = { "fits", "shrink", "absorb", "extend", "remap", "move" };
+  int i, first = 1;
+
+  fprintf( out, "{\"counted\": %d, \"mallocs\": %lu, \"frees\": %lu, \"remote_frees\": %lu, "
+	   "\"reallocs\": %lu, ", s->counted, s->mallocs, s->frees, s->remote_frees, s->reallocs );
+  fprintf( out, "\"realloc_paths\": {" );
+  for( i = 0; i < MM_REALLOC_PATHS; i++ )
+    fprintf( out, "%s\"%s\": %lu", i ? ", " : "", paths[i], s->realloc_paths[i] );
+  fprintf( out, "}, \"splits\": %lu, \"coalesce_prev\": %lu, \"coalesce_next\": %lu, "
+	   "\"coalesce_both\": %lu, ", s->splits, s->coalesce_prev, s->coalesce_next, s->coalesce_both );
+  fprintf( out, "\"sbrk_calls\": %lu, \"sbrk_bytes\": %zu, \"trims\": %lu, \"trim_bytes\": %zu, "
+	   "\"mmaps\": %lu, \"mmapped_bytes\": %zu, \"slab_runs\": %lu, ", s->sbrk_calls,
+	   s->sbrk_bytes, s->trims, s->trim_bytes, s->mmaps, s->mmapped_bytes, s->slab_runs );
+  fprintf( out, "\"fit_searches\": %lu, \"fit_probes\": %lu, \"quick_hits\": %lu, "
+	   "\"consolidations\": %lu, \"live_bytes\": %zu, \"peak_bytes\": %zu, \"heap_bytes\": %zu, "
+	   "\"free_lists\": [", s->fit_searches, s->fit_probes, s->quick_hits, s->consolidations,
+	   s->live_bytes, s->peak_bytes, s->heap_bytes );
+  for( i = 0; i < s->classes; i++ )
+    if( s->free_blocks[i] ){
+      fprintf( out, "%s[%d, %zu, %lu, %zu]", first ? "" : ", ",
+	       i, s->class_min[i], s->free_blocks[i], s->free_bytes[i] );
+      first = 0;
+    }
+  fprintf( out, "]}\n" );
+}